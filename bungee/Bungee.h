@@ -6,6 +6,7 @@
 #include "Modes.h"
 
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 
 namespace Bungee {
@@ -52,22 +53,96 @@ struct InputChunk
 
 // Describes a chunk of audio output
 // Output chunks do not overlap and can be appended for seamless playback
+// Sample f of channel c is at data[f * frameStride + c * channelStride]
 struct OutputChunk
 {
 	float *data; // audio output data, not aligned
 	int frameCount;
 	intptr_t channelStride;
+	intptr_t frameStride = 1; // 1 for planar output, channel count for interleaved output
 
 	static constexpr int begin = 0, end = 1;
 	Request *request[2 /* 0=begin, 1=end */];
 };
 
+// Describes a caller-owned buffer, such as a mixing bus, into which synthesis writes or adds its output
+// Sample f of channel c is at data[f * frameStride + c * channelStride]
+struct OutputDestination
+{
+	float *data; // must have room for maxOutputFrameCount() frames
+	intptr_t channelStride;
+	intptr_t frameStride;
+	bool accumulate; // add to the buffer's existing contents rather than overwrite them
+
+	// Gain ramps linearly from gain[begin] at the chunk's first frame towards gain[end], which
+	// would be reached at the frame following the chunk. Successive ramps can thus be made continuous.
+	static constexpr int begin = 0, end = 1;
+	float gain[2 /* 0=begin, 1=end */];
+};
+
 struct SampleRates
 {
 	int input;
 	int output;
 };
 
+// Prepares the FFT state shared by all Stretcher objects of the given sample rates. Afterwards,
+// constructing such stretchers and processing their grains take no locks and allocate no FFT state.
+// State for 44.1kHz and 48kHz input with the balanced profile is prepared when the library loads. This function
+// is thread safe but may lock and allocate, so call it at startup or from a non-real-time thread.
+void warmUp(SampleRates sampleRates, ProfileMode profileMode = ProfileMode::balanced);
+
+// Counters and timings of a Stretcher's work, for monitoring whether it keeps within a real-time budget and,
+// if not, which stage is responsible. They are gathered only if the library is built with the CMake option
+// BUNGEE_INSTRUMENTATION, otherwise they read as zero and gathering them compiles to nothing.
+struct Statistics
+{
+	enum Stage
+	{
+		analysis,
+		forwardTransform,
+		synthesis,
+		inverseTransform,
+		resample,
+		stageCount
+	};
+
+	// Cumulative ticks spent in each stage: CPU cycles on x86, generic timer counts on Arm64, nanoseconds elsewhere
+	uint64_t ticks[stageCount];
+
+	uint64_t grainCount; // valid grains specified
+	uint64_t discontinuousGrainCount; // valid grains that follow a reset or an invalid grain
+	uint64_t passthroughGrainCount; // valid grains at unit speed that need no phase processing
+	uint64_t resampledGrainCount; // valid grains for which input or output resampling is active
+
+	// histogram[i] counts grains whose analyseGrain and synthesiseGrain took between 2^(i-1) and 2^i ticks in total
+	static constexpr int histogramSize = 64;
+	uint64_t histogram[histogramSize];
+	uint64_t maxGrainTicks;
+};
+
+// Remembers the analysis of grains so that, when the same input is played again, as when looping or scrubbing,
+// a Stretcher need only synthesise them. A grain is found in the cache if its InputChunk, pitch and resampling
+// match those of a grain analysed earlier. The cache knows nothing of the audio itself, so call clear() if the
+// input audio changes, and give each audio file a sidecar path of its own.
+// grainCount slots are held in memory or, if path is given and the platform supports it, in a memory-mapped file
+// at path that persists them between sessions. A file written with a different configuration is reinitialised.
+// The file is locked while the cache exists: if another process holds it, the cache is held in memory instead.
+// The constructor allocates. A cache may be attached to only one Stretcher at a time.
+struct AnalysisCache
+{
+	struct Implementation;
+	Implementation *const state;
+
+	AnalysisCache(SampleRates sampleRates, int channelCount, int grainCount, const char *path = nullptr, ProfileMode profileMode = ProfileMode::balanced);
+	~AnalysisCache();
+
+	// Returns true if the cache is held in the file given to the constructor
+	bool persistent() const;
+
+	void clear();
+};
+
 struct Configuration;
 
 struct Stretcher
@@ -75,15 +150,31 @@ struct Stretcher
 	struct Implementation;
 	Implementation *const state;
 
-	Stretcher(SampleRates sampleRates, int channelCount);
+	// See BUNGEE_MODES_PROFILE in Modes.h for the available latency and CPU load trade-offs.
+	// With PipelineMode::twoThread, the Stretcher starts a worker thread that analyses each grain while the caller
+	// synthesises its predecessor: synthesiseGrain then emits the output of the grain before the one just analysed.
+	Stretcher(SampleRates sampleRates, int channelCount, ProfileMode profileMode = ProfileMode::balanced, PipelineMode pipelineMode = PipelineMode::sequential);
+
+	// Constructs a Stretcher whose entire state occupies one contiguous block within the caller's arena.
+	// The arena need not be aligned, must be at least requiredBytes() long and must outlive the Stretcher.
+	// This constructor does not allocate so, after warmUp(), it is safe to call on a real-time thread,
+	// unless PipelineMode::twoThread is requested, which starts a thread.
+	Stretcher(SampleRates sampleRates, int channelCount, void *arena, ProfileMode profileMode = ProfileMode::balanced, PipelineMode pipelineMode = PipelineMode::sequential);
 
 	~Stretcher();
 
+	// Returns the size of arena needed to construct a Stretcher with the given parameters.
+	// This function allocates, so call it at startup or from a non-real-time thread.
+	static std::size_t requiredBytes(SampleRates sampleRates, int channelCount, ProfileMode profileMode = ProfileMode::balanced, PipelineMode pipelineMode = PipelineMode::sequential);
+
 	// Returns the largest number of frames that might be requested by specifyGrain()
 	// This helps the caller to allocate large enough buffers because it is guaranteed that
 	// InputChunk::frameCount() will not exceed this number.
 	int maxInputFrameCount() const;
 
+	// OutputChunk::frameCount will not exceed this number.
+	int maxOutputFrameCount() const;
+
 	// This function adjusts request.position so that the stretcher has a run in of a few
 	// grains before hitting the requested position. Without preroll, the first milliseconds
 	// of audio might sound weak or initial transients might be lost.
@@ -101,11 +192,83 @@ struct Stretcher
 	// specified by specifyGrain's return value. After calling this function, call synthesiseGrain.
 	void analyseGrain(const float *data, intptr_t channelStride);
 
+	// As above, for audio whose sample f of channel c is at data[f * frameStride + c * channelStride].
+	// For interleaved audio, channelStride is 1 and frameStride is the channel count. Deinterleaving is
+	// done as the grain is windowed, so no intermediate copy is needed.
+	void analyseGrain(const float *data, intptr_t channelStride, intptr_t frameStride);
+
 	// Complete processing of the grain of audio that was previously set up with calls to specifyGrain and analyseGrain.
 	void synthesiseGrain(OutputChunk &outputChunk);
 
+	// As above, but outputChunk's audio is interleaved: its channelStride is 1 and its frameStride is the channel count.
+	// Interleaving is done as the output is resampled or copied out, so no intermediate copy is needed.
+	void synthesiseGrainInterleaved(OutputChunk &outputChunk);
+
+	// As above, but the output is written or added, with a gain ramp, into the caller's destination buffer.
+	// On return, outputChunk describes the frames of the destination that received output.
+	void synthesiseGrain(OutputChunk &outputChunk, const OutputDestination &destination);
+
 	// Returns true if every grain in the stretcher's pipeline is invalid (its Request::position was NaN).
 	bool isFlushed() const;
+
+	// Returns the counters and timings gathered so far. Takes no locks and may be called from any thread.
+	// With PipelineMode::twoThread, the worker thread's transforms and analysis are included in Statistics::ticks but
+	// not in the histogram or maxGrainTicks. Those measure the caller's thread only, because the worker's ticks for one
+	// grain overlap the caller's for another.
+	Statistics statistics() const;
+
+	// Attaches a cache, or detaches with nullptr, that has the Stretcher's sample rates, channel count and profile.
+	// Analysis of grains found in the cache is copied from it; analysis of other grains is stored in it.
+	void setAnalysisCache(AnalysisCache *analysisCache);
+
+	// Returns true if the grain just specified was found in the attached cache. Its analyseGrain then reads
+	// no input audio, so data may be null. Grain processing may touch the pages of a persistent cache's file.
+	bool isAnalysisCached() const;
+};
+
+// Holds many voices that share sample rates and channel count, each behaving as an independent Stretcher.
+// Every call processes a grain for all voices together, but only the transforms are batched: each forward or
+// inverse FFT covers every voice in one kernel call, while windowing, analysis and phase rotation run voice by
+// voice as they would in separate Stretchers. Arrays passed to and from the member functions have one element per voice.
+// A voice that is to be silent should be given a Request with NaN position.
+struct StretcherBank
+{
+	struct Implementation;
+	Implementation *const state;
+
+	StretcherBank(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode = ProfileMode::balanced);
+
+	// As Stretcher's equivalent: the bank and all of its voices occupy one contiguous block within the caller's arena.
+	StretcherBank(SampleRates sampleRates, int channelCount, int voiceCount, void *arena, ProfileMode profileMode = ProfileMode::balanced);
+
+	~StretcherBank();
+
+	// Returns the size of arena needed to construct a StretcherBank with the given parameters.
+	static std::size_t requiredBytes(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode = ProfileMode::balanced);
+
+	int voiceCount() const;
+
+	// See Stretcher's functions of the same names.
+	int maxInputFrameCount() const;
+	int maxOutputFrameCount() const;
+	void preroll(Request &request) const;
+	void next(Request &request) const;
+
+	// Specify a grain for every voice and compute each voice's necessary segment of input audio.
+	void specifyGrains(const Request requests[], InputChunk inputChunks[]);
+
+	// Begins processing every voice's grain. Each voice's audio should correspond to its InputChunk.
+	void analyseGrains(const float *const data[], const intptr_t channelStrides[]);
+
+	// Completes processing of every voice's grain.
+	void synthesiseGrains(OutputChunk outputChunks[]);
+
+	// As above, but each voice's output is written or added into its destination. Voices may share a
+	// destination with OutputDestination::accumulate set so that they mix directly into one bus.
+	void synthesiseGrains(OutputChunk outputChunks[], const OutputDestination destinations[]);
+
+	// Returns true if every grain in the given voice's pipeline is invalid.
+	bool isFlushed(int voice) const;
 };
 
 } // namespace Bungee
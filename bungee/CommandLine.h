@@ -2,21 +2,39 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "bungee/Bungee.h"
+#include "bungee/Pull.h"
 #include "bungee/Push.h"
 
 #define CXXOPTS_NO_EXCEPTIONS
 #include "cxxopts.hpp"
 #undef CXXOPTS_NO_EXCEPTIONS
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <numbers>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace Bungee::CommandLine {
 
 static void fail(const char *message)
@@ -40,12 +58,36 @@ struct Options :
 		add_options(helpGroups.emplace_back("Sample rate")) //
 			("output-rate", "output sample rate, Hz, or 0 to match input sample rate", cxxopts::value<int>()->default_value("0")) //
 			;
+		add_options(helpGroups.emplace_back("Output format")) //
+			("dither", "add TPDF dither when quantising output to integer samples") //
+			;
 		add_options(helpGroups.emplace_back("Stretch")) //
 			("s,speed", "output speed as multiple of input speed", cxxopts::value<double>()->default_value("1")) //
 			("p,pitch", "output pitch shift in semitones", cxxopts::value<double>()->default_value("0")) //
 			;
+#define X_BEGIN(Type, type) \
+	{ \
+		std::string help = #type " mode:"; \
+		std::string defaultMode;
+#define X_ITEM(Type, type, mode, description) \
+	help += std::string("\n    ") + #mode + ": " + description; \
+	if (defaultMode.empty()) \
+		defaultMode = #mode;
+#define X_END(Type, type) \
+	add_options(helpGroups.emplace_back(#Type " mode"))(#type, help, cxxopts::value<std::string>()->default_value(defaultMode)); \
+	}
+		BUNGEE_MODES
+		BUNGEE_MODES_PROFILE
+		BUNGEE_MODES_PIPELINE
+#undef X_BEGIN
+#undef X_ITEM
+#undef X_END
+		add_options(helpGroups.emplace_back("Performance")) //
+			("threads", "number of threads for offline rendering, each rendering a segment of the timeline; neighbouring segments are crossfaded over a few grains at each seam, and output differs from a single-threaded render from the first seam onwards", cxxopts::value<int>()->default_value("1")) //
+			;
 		add_options("Developer / Debug") //
 			("push", "input push chunk size (0 for default input pull operation)", cxxopts::value<int>()->default_value("0")) //
+			("block", "fixed output block size, delivered by Pull::OutputBuffer (0 for default output per grain)", cxxopts::value<int>()->default_value("0")) //
 			;
 		add_options(helpGroups.emplace_back("Help")) //
 			("h,help", "display this message") //
@@ -59,6 +101,9 @@ struct Options :
 struct Parameters :
 	cxxopts::ParseResult
 {
+	ProfileMode profileMode{};
+	PipelineMode pipelineMode{};
+
 	Parameters(Options &options, int argc, const char *argv[], Request &request) :
 		cxxopts::ParseResult(options.parse(argc, argv))
 	{
@@ -85,32 +130,367 @@ struct Parameters :
 
 		if ((*this)["push"].as<int>() && request.speed < 0.)
 			fail("when pushing speed must be positive");
+
+#define X_BEGIN(Type, type) \
+	{ \
+		const auto value = (*this)[#type].as<std::string>(); \
+		bool found = false;
+#define X_ITEM(Type, type, mode, description) \
+	if (value == #mode) \
+	{ \
+		request.type##Mode = Type##Mode::mode; \
+		found = true; \
+	}
+#define X_END(Type, type) \
+	if (!found) \
+		fail("unrecognised " #type " mode"); \
+	}
+		BUNGEE_MODES
+#undef X_ITEM
+#define X_ITEM(Type, type, mode, description) \
+	if (value == #mode) \
+	{ \
+		type##Mode = Type##Mode::mode; \
+		found = true; \
+	}
+		BUNGEE_MODES_PROFILE
+		BUNGEE_MODES_PIPELINE
+#undef X_BEGIN
+#undef X_ITEM
+#undef X_END
+
+		const auto threads = (*this)["threads"].as<int>();
+		if (threads < 1 || threads > 256)
+			fail("threads must be in the range 1 to 256");
+		if (threads > 1 && (*this)["push"].as<int>())
+			fail("push operation is not available when rendering on multiple threads");
+
+		const auto block = (*this)["block"].as<int>();
+		if (block < 0 || block > 1 << 16)
+			fail("block must be in the range 0 to 65536");
+		if (block && (threads > 1 || (*this)["push"].as<int>()))
+			fail("block output is not available when pushing or rendering on multiple threads");
 	}
 };
 
+// Conversion between the little-endian interleaved sample data of WAV files and floating-point audio.
+// Each loop converts a contiguous run of samples without branches so that it can be vectorised. The
+// Processor converts a block of frames at a time and transposes between interleaved and planar
+// layouts while the block is still in cache.
+namespace Pcm {
+
+template <typename Unsigned>
+static inline Unsigned load(const char *p)
+{
+	Unsigned x;
+	if constexpr (std::endian::native == std::endian::little)
+		std::memcpy(&x, p, sizeof(x));
+	else
+	{
+		x = 0;
+		for (unsigned i = 0; i < sizeof(x); ++i)
+			x |= Unsigned(uint8_t(p[i])) << 8 * i;
+	}
+	return x;
+}
+
+template <typename Unsigned>
+static inline void store(char *p, Unsigned x)
+{
+	if constexpr (std::endian::native == std::endian::little)
+		std::memcpy(p, &x, sizeof(x));
+	else
+		for (unsigned i = 0; i < sizeof(x); ++i)
+			p[i] = char(x >> 8 * i);
+}
+
+// Rounds x, which is scaled such that full scale is 2^(bits-1), to the nearest integer (halves away
+// from zero, like std::round) and saturates it to the range of a signed integer of the given width.
+template <int bits>
+static inline int32_t quantise(float x)
+{
+	constexpr float limit = float(1ll << (bits - 1));
+	constexpr int32_t max = int32_t((1ll << (bits - 1)) - 1);
+	// the largest float below 2^31 is 2^31 - 128, for narrower types limit itself converts exactly
+	constexpr float upper = bits == 32 ? limit - 128.f : limit;
+
+	const float clamped = std::min(std::max(x, -limit), upper);
+	int32_t i = int32_t(clamped);
+	const float fraction = clamped - float(i);
+	i += (fraction >= .5f) - (fraction <= -.5f);
+	return x >= limit ? max : std::min(i, max);
+}
+
+enum class Encoding
+{
+	integer = 1, // WAVE_FORMAT_PCM
+	ieeeFloat = 3, // WAVE_FORMAT_IEEE_FLOAT
+};
+
+template <Encoding encoding, int bits>
+struct Sample
+{
+	static constexpr int bytes = bits / 8;
+
+	static void toFloat(const char *source, float *destination, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			const char *p = source + i * bytes;
+			if constexpr (encoding == Encoding::ieeeFloat && bits == 32)
+				destination[i] = std::bit_cast<float>(load<uint32_t>(p));
+			else if constexpr (encoding == Encoding::ieeeFloat && bits == 64)
+				destination[i] = float(std::bit_cast<double>(load<uint64_t>(p)));
+			else if constexpr (bits == 8) // offset binary
+				destination[i] = (int(uint8_t(*p)) - 128) * (1.f / 128);
+			else if constexpr (bits == 16)
+				destination[i] = int16_t(load<uint16_t>(p)) * (1.f / 32768);
+			else if constexpr (bits == 24) // placed in the most significant bytes of an int32_t
+				destination[i] = int32_t(uint32_t(uint8_t(p[0])) << 8 | uint32_t(uint8_t(p[1])) << 16 | uint32_t(uint8_t(p[2])) << 24) * (1.f / 2147483648.f);
+			else
+				destination[i] = int32_t(load<uint32_t>(p)) * (1.f / 2147483648.f);
+		}
+	}
+
+	// dither, if not null, holds noise to be added to each sample, in units of the output's least-significant bit
+	static void fromFloat(const float *source, char *destination, int count, const float *dither)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			char *p = destination + i * bytes;
+			if constexpr (encoding == Encoding::ieeeFloat && bits == 32)
+				store<uint32_t>(p, std::bit_cast<uint32_t>(source[i]));
+			else if constexpr (encoding == Encoding::ieeeFloat && bits == 64)
+				store<uint64_t>(p, std::bit_cast<uint64_t>(double(source[i])));
+			else
+			{
+				float x = source[i] * float(1ll << (bits - 1));
+				if (dither)
+					x += dither[i];
+				const auto q = quantise<bits>(x);
+				if constexpr (bits == 8)
+					*p = char(q + 128);
+				else if constexpr (bits == 16)
+					store<uint16_t>(p, uint16_t(q));
+				else if constexpr (bits == 24)
+				{
+					p[0] = char(q);
+					p[1] = char(q >> 8);
+					p[2] = char(q >> 16);
+				}
+				else
+					store<uint32_t>(p, uint32_t(q));
+			}
+		}
+	}
+};
+
+struct Codec
+{
+	int bytesPerSample;
+	bool quantised;
+	void (*toFloat)(const char *source, float *destination, int count);
+	void (*fromFloat)(const float *source, char *destination, int count, const float *dither);
+
+	// Returns a codec for the given format or one with zero bytesPerSample if the format is not supported
+	static Codec select(int formatTag, int bitsPerSample)
+	{
+		const auto codec = [](auto sample, bool quantised) {
+			typedef decltype(sample) S;
+			return Codec{S::bytes, quantised, &S::toFloat, &S::fromFloat};
+		};
+
+		if (formatTag == int(Encoding::integer))
+			switch (bitsPerSample)
+			{
+			case 8:
+				return codec(Sample<Encoding::integer, 8>{}, true);
+			case 16:
+				return codec(Sample<Encoding::integer, 16>{}, true);
+			case 24:
+				return codec(Sample<Encoding::integer, 24>{}, true);
+			case 32:
+				return codec(Sample<Encoding::integer, 32>{}, true);
+			}
+		else if (formatTag == int(Encoding::ieeeFloat))
+			switch (bitsPerSample)
+			{
+			case 32:
+				return codec(Sample<Encoding::ieeeFloat, 32>{}, false);
+			case 64:
+				return codec(Sample<Encoding::ieeeFloat, 64>{}, false);
+			}
+		return Codec{};
+	}
+};
+
+// Triangular-PDF dither of +/-1 LSB peak. Each value is a hash of its sample's index in the output
+// stream, so that a block of values can be computed in a vectorisable loop and is reproducible.
+static void tpdfDither(float *dither, std::uint64_t index, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		uint32_t h = uint32_t(index + i) * 0x9e3779b1u;
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		dither[i] = (int(h & 0xffff) - int(h >> 16)) * (1.f / 65536);
+	}
+}
+
+} // namespace Pcm
+
+// Read-only view of a whole file, mapped into memory so that its pages are loaded only as they are accessed.
+struct MappedFile
+{
+	const char *data = nullptr;
+	std::size_t size = 0;
+
+	MappedFile(const std::string &filename)
+	{
+#ifdef _WIN32
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			fail("Please check your input file: could not open it");
+
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart)
+		{
+			size = std::size_t(fileSize.QuadPart);
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping)
+				data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		const int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			fail("Please check your input file: could not open it");
+
+		struct stat status;
+		if (fstat(fd, &status) == 0 && status.st_size > 0)
+		{
+			size = std::size_t(status.st_size);
+			const auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (address != MAP_FAILED)
+				data = static_cast<const char *>(address);
+		}
+		close(fd);
+#endif
+		if (!data)
+			fail("Please check your input file: there was a problem reading it");
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mapping);
+		CloseHandle(file);
+#else
+		munmap(const_cast<char *>(data), size);
+#endif
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+#ifdef _WIN32
+private:
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
 struct Processor
 {
+	struct InputAudio
+	{
+		const float *data;
+		int channelStride;
+	};
+
+	// Planar audio converted on demand from the input file. It spans at least one grain's input and
+	// is refilled, centred on the requested chunk, only when a chunk falls outside it.
+	struct InputWindow
+	{
+		const Processor &processor;
+		int begin = 0;
+		int channelStride = 0;
+		std::vector<float> audio;
+
+		InputWindow(const Processor &processor) :
+			processor(processor)
+		{
+		}
+
+		InputAudio operator()(InputChunk inputChunk)
+		{
+			const int length = inputChunk.end - inputChunk.begin;
+			if (!length)
+				return {nullptr, channelStride};
+
+			bool valid = begin <= inputChunk.begin && inputChunk.end <= begin + channelStride;
+			if (length > channelStride)
+			{
+				channelStride = 1 << 13;
+				while (channelStride < 2 * length)
+					channelStride *= 2;
+				audio.resize(processor.channelCount * std::size_t(channelStride));
+				valid = false;
+			}
+
+			if (!valid)
+			{
+				begin = inputChunk.begin - (channelStride - length) / 2;
+				processor.decode(audio.data(), channelStride, begin, channelStride);
+			}
+
+			return {&audio[inputChunk.begin - begin], channelStride};
+		}
+	};
+
+	MappedFile inputFile;
 	std::vector<char> wavHeader;
-	std::vector<char> wavData;
-	decltype(wavData.begin()) o;
+	const char *wavData;
 	SampleRates sampleRates;
 	int inputFrameCount;
-	int inputFramesPad;
-	int inputChannelStride;
 	int channelCount;
 	int bitsPerSample;
-	std::vector<float> inputBuffer;
-	std::ifstream inputFile;
+	Pcm::Codec codec;
+	InputWindow inputWindow{*this};
+	int outputFrameCount;
+	int outputFramesWritten;
+	std::vector<char> outputBuffer;
+	std::size_t outputBufferUsed;
+	std::vector<float> outputBlock;
+	std::vector<float> outputDither;
+	bool dither;
 	std::ofstream outputFile;
+	std::mutex outputFileMutex; // held by writeAt
 
-	Processor(const cxxopts::ParseResult &parameters, Request &request) :
-		inputFile(parameters["input"].as<std::string>(), std::ios::binary)
+	// Buffers for converting a block of output, one set per thread that calls writeAt
+	struct OutputScratch
 	{
-		if (!inputFile)
-			fail("Please check your input file: could not open it");
+		std::vector<float> block;
+		std::vector<float> dither;
+		std::vector<char> bytes;
+
+		OutputScratch(const Processor &processor) :
+			block(std::size_t(processor.channelCount) << 12),
+			dither(processor.dither ? block.size() : 0),
+			bytes(block.size() * processor.codec.bytesPerSample)
+		{
+		}
+	};
 
-		wavHeader.resize(20);
-		inputFile.read(wavHeader.data(), wavHeader.size());
+	Processor(const cxxopts::ParseResult &parameters, Request &request) :
+		inputFile(parameters["input"].as<std::string>())
+	{
+		if (inputFile.size < 20)
+			fail("Please check your input file: it seems not to be a compatible WAV file (too short)");
+		wavHeader.assign(inputFile.data, inputFile.data + 20);
 
 		if (read<uint32_t>(&wavHeader[0]) != read<uint32_t>("RIFF"))
 			fail("Please check your input file: it seems not to be a compatible WAV file (no 'RIFF')");
@@ -124,10 +504,10 @@ struct Processor
 		int subchunkCount = 0;
 		while (read<uint32_t>(&wavHeader[wavHeader.size() - 8]) != read<uint32_t>("data"))
 		{
-			const auto len = read<uint32_t>(&wavHeader[wavHeader.size() - 4]) + 8;
-			wavHeader.resize(wavHeader.size() + len);
-			if (!inputFile.read(wavHeader.data() + wavHeader.size() - len, len))
+			const auto len = std::size_t(read<uint32_t>(&wavHeader[wavHeader.size() - 4])) + 8;
+			if (len > inputFile.size - wavHeader.size())
 				fail("Please check your input file: there was a problem reading one of its chunks");
+			wavHeader.insert(wavHeader.end(), inputFile.data + wavHeader.size(), inputFile.data + wavHeader.size() + len);
 
 			if (subchunkCount++ == 0)
 			{
@@ -143,8 +523,17 @@ struct Processor
 				if (sampleRates.output < 8000 || sampleRates.output > 192000)
 					fail("Output sample rate must be in the range [8000, 192000] kHz");
 
+				int formatTag = read<uint16_t>(&wavHeader[20]);
+				if (formatTag == 0xfffe) // WAVE_FORMAT_EXTENSIBLE
+				{
+					if (read<uint32_t>(&wavHeader[16]) < 40)
+						fail("Please check your input file: it seems not to be a compatible WAV file (extensible format length less than 40)");
+					formatTag = read<uint16_t>(&wavHeader[44]);
+				}
+
 				channelCount = read<uint16_t>(&wavHeader[22]);
 				bitsPerSample = read<uint16_t>(&wavHeader[34]);
+				codec = Pcm::Codec::select(formatTag, bitsPerSample);
 				if (!channelCount)
 					fail("Please check your input file: it seems not to be a compatible WAV file (zero channels)");
 				if (read<int32_t>(&wavHeader[28]) != sampleRates.input * channelCount * bitsPerSample / 8)
@@ -153,46 +542,43 @@ struct Processor
 					fail("Please check your input file: it seems not to be a compatible WAV file (inconsistent at position 32)'");
 			}
 		}
-		wavData.resize(read<uint32_t>(&wavHeader[wavHeader.size() - 4]));
-		if (!inputFile.read(wavData.data(), wavData.size()))
+
+		const std::size_t dataSize = read<uint32_t>(&wavHeader[wavHeader.size() - 4]);
+		if (dataSize > inputFile.size - wavHeader.size())
 			fail("Please check your input file: there was a problem reading its audio data");
+		wavData = inputFile.data + wavHeader.size();
 
-		inputFrameCount = int(8 * wavData.size() / bitsPerSample / channelCount);
+		if (!codec.bytesPerSample)
+			fail("Please check your input file: only 8, 16, 24 and 32-bit PCM and 32 and 64-bit float are supported");
 
-		inputFramesPad = 1 << 12;
-		inputChannelStride = inputFramesPad + inputFrameCount + inputFramesPad;
-		inputBuffer.resize(channelCount * inputChannelStride);
-
-		if (bitsPerSample == 16)
-		{
-			for (int i = 0; i < inputFrameCount; ++i)
-				for (int c = 0; c < channelCount; ++c)
-					inputBuffer[c * inputChannelStride + inputFramesPad + i] = toFloat(read<int16_t>(&wavData[(i * channelCount + c) * sizeof(int16_t)]));
-		}
-		else if (bitsPerSample == 32)
-		{
-			for (int i = 0; i < inputFrameCount; ++i)
-				for (int c = 0; c < channelCount; ++c)
-					inputBuffer[c * inputChannelStride + inputFramesPad + i] = toFloat(read<int32_t>(&wavData[(i * channelCount + c) * sizeof(int32_t)]));
-		}
-		else
-			fail("Please check your input file: only 16-bit and 32-bit PCM are supported");
-
-		std::fill(wavData.begin(), wavData.end(), 0);
+		inputFrameCount = int(dataSize / codec.bytesPerSample / channelCount);
 
 		outputFile.open(parameters["output"].as<std::string>(), std::ios::binary);
 		if (!outputFile)
 			fail("Please check your output path: there was a problem opening the output file");
 
-		const auto nOutput = int(inputFrameCount / std::max(.01, fabs(request.speed)) * sampleRates.output / sampleRates.input);
-		wavData.resize(nOutput * channelCount * bitsPerSample / 8);
+		outputFrameCount = int(inputFrameCount / std::max(.01, fabs(request.speed)) * sampleRates.output / sampleRates.input);
+		outputBuffer.resize(std::size_t(channelCount) * codec.bytesPerSample << 12);
+		outputBlock.resize(std::size_t(channelCount) << 12);
+		dither = parameters.count("dither") && codec.quantised;
+		if (dither)
+			outputDither.resize(outputBlock.size());
+
+		const auto outputDataSize = uint32_t(std::size_t(outputFrameCount) * channelCount * codec.bytesPerSample);
+		write<uint32_t>(&wavHeader[4], uint32_t(wavHeader.size() + outputDataSize - 8));
+		write<uint32_t>(&wavHeader[24], uint32_t(sampleRates.output));
+		write<uint32_t>(&wavHeader[28], uint32_t(sampleRates.output * channelCount * bitsPerSample / 8));
+		write<uint32_t>(&wavHeader[wavHeader.size() - 4], outputDataSize);
+		outputFile.write(wavHeader.data(), wavHeader.size());
 
 		restart(request);
 	}
 
 	void restart(Request &request)
 	{
-		o = wavData.begin();
+		outputFile.seekp(wavHeader.size());
+		outputFramesWritten = 0;
+		outputBufferUsed = 0;
 
 		if (request.speed < 0)
 			request.position = inputFrameCount - 1;
@@ -216,7 +602,7 @@ struct Processor
 			if (outputChunk.frameCount > nPrerollOutput)
 			{
 				outputChunk.frameCount -= nPrerollOutput;
-				outputChunk.data += nPrerollOutput;
+				outputChunk.data += nPrerollOutput * outputChunk.frameStride;
 				return writeChunk(outputChunk);
 			}
 		}
@@ -224,68 +610,123 @@ struct Processor
 		return false;
 	}
 
-	const float *getInputAudio(InputChunk inputChunk) const
+	InputAudio getInputAudio(InputChunk inputChunk)
 	{
-		const float *audio = nullptr;
-		if (inputChunk.begin != inputChunk.end)
-		{
-			inputChunk.begin += inputFramesPad;
-			inputChunk.end += inputFramesPad;
-			if (inputChunk.begin < 0)
-			{
-				inputChunk.begin -= inputChunk.begin;
-				inputChunk.end -= inputChunk.begin;
-			}
-			else if (inputChunk.end > inputChannelStride)
-			{
-				inputChunk.begin -= inputChunk.end - inputChannelStride;
-				inputChunk.end -= inputChunk.end - inputChannelStride;
-			}
-			audio = &inputBuffer[inputChunk.begin];
-		}
-		return audio;
+		return inputWindow(inputChunk);
 	}
 
 	void getInputAudio(float *p, int stride, int position, int length) const
 	{
-		const float *source = getInputAudio(InputChunk{position, position + length});
+		decode(p, stride, position, length);
+	}
+
+	// Converts input frames [position, position + length) to planar float, with silence beyond either end of the file
+	void decode(float *p, std::ptrdiff_t stride, int position, int length) const
+	{
+		const int begin = std::clamp(-position, 0, length);
+		const int end = std::clamp(inputFrameCount - position, begin, length);
+
 		for (int c = 0; c < channelCount; ++c)
-			for (int i = 0; i < length; ++i)
-				p[c * stride + i] = source[c * inputChannelStride + i];
+		{
+			std::fill(p + c * stride, p + c * stride + begin, 0.f);
+			std::fill(p + c * stride + end, p + c * stride + length, 0.f);
+		}
+
+		const int blockFrames = std::max(1, (1 << 12) / channelCount);
+		std::vector<float> block(std::size_t(blockFrames) * channelCount);
+		for (int f = begin; f < end; f += blockFrames)
+		{
+			const int n = std::min(blockFrames, end - f);
+			codec.toFloat(wavData + (std::size_t(position) + f) * channelCount * codec.bytesPerSample, block.data(), n * channelCount);
+			for (int c = 0; c < channelCount; ++c)
+				for (int i = 0; i < n; ++i)
+					p[c * stride + f + i] = block[i * channelCount + c];
+		}
 	}
 
-	template <typename Sample>
-	bool writeSamples(Bungee::OutputChunk chunk)
+	void flushOutput()
 	{
-		const int count = std::min<int>(chunk.frameCount * channelCount, (wavData.end() - o) / sizeof(Sample));
+		outputFile.write(outputBuffer.data(), outputBufferUsed);
+		outputBufferUsed = 0;
+	}
 
-		for (int f = 0; f < count / channelCount; ++f)
+	// Converts n frames of chunk, from its frame f, to the output file's format. The frames are destined for
+	// output frame position, from which their dither is derived.
+	void encode(const Bungee::OutputChunk &chunk, int f, int n, std::ptrdiff_t position, char *bytes, float *block, float *ditherBlock) const
+	{
+		// interleaved chunks are converted in place, others are first interleaved into block
+		const float *data = chunk.data + f * chunk.frameStride;
+		if (chunk.frameStride != channelCount || (channelCount > 1 && chunk.channelStride != 1))
+		{
 			for (int c = 0; c < channelCount; ++c)
-			{
-				write<Sample>(&*o, fromFloat<Sample>(chunk.data[f + c * chunk.channelStride]));
-				o += sizeof(Sample);
-			}
+				for (int i = 0; i < n; ++i)
+					block[i * channelCount + c] = chunk.data[(f + i) * chunk.frameStride + c * chunk.channelStride];
+			data = block;
+		}
 
-		return o == wavData.end();
+		if (dither)
+			Pcm::tpdfDither(ditherBlock, std::uint64_t(position) * channelCount, n * channelCount);
+
+		codec.fromFloat(data, bytes, n * channelCount, dither ? ditherBlock : nullptr);
 	}
 
 	bool writeChunk(Bungee::OutputChunk chunk)
 	{
-		if (bitsPerSample == 32)
-			return writeSamples<int32_t>(chunk);
-		else
-			return writeSamples<int16_t>(chunk);
+		const int frameCount = std::min(chunk.frameCount, outputFrameCount - outputFramesWritten);
+		const int bytesPerFrame = channelCount * codec.bytesPerSample;
+
+		for (int f = 0; f < frameCount;)
+		{
+			if (outputBufferUsed == outputBuffer.size())
+				flushOutput();
+
+			const int n = std::min<int>(frameCount - f, (outputBuffer.size() - outputBufferUsed) / bytesPerFrame);
+			encode(chunk, f, n, outputFramesWritten + f, &outputBuffer[outputBufferUsed], outputBlock.data(), outputDither.data());
+			outputBufferUsed += std::size_t(n) * bytesPerFrame;
+			f += n;
+		}
+		outputFramesWritten += frameCount;
+
+		return outputFramesWritten == outputFrameCount;
+	}
+
+	// Writes chunk at output frame position, dropping any frames outside the output. Unlike writeChunk, this
+	// may be called concurrently, each thread with scratch of its own, to write disjoint ranges of the output.
+	void writeAt(std::ptrdiff_t position, Bungee::OutputChunk chunk, OutputScratch &scratch)
+	{
+		const int begin = int(std::clamp<std::ptrdiff_t>(-position, 0, chunk.frameCount));
+		const int end = int(std::clamp<std::ptrdiff_t>(outputFrameCount - position, begin, chunk.frameCount));
+		const int bytesPerFrame = channelCount * codec.bytesPerSample;
+
+		for (int f = begin; f < end;)
+		{
+			const int n = std::min<int>(end - f, scratch.block.size() / channelCount);
+			encode(chunk, f, n, position + f, scratch.bytes.data(), scratch.block.data(), scratch.dither.data());
+
+			const std::lock_guard lock(outputFileMutex);
+			outputFile.seekp(std::streamoff(wavHeader.size() + (position + f) * bytesPerFrame));
+			outputFile.write(scratch.bytes.data(), std::streamsize(n) * bytesPerFrame);
+			f += n;
+		}
 	}
 
 	void writeOutputFile()
 	{
-		write<uint32_t>(&wavHeader[4], uint32_t(wavHeader.size() + wavData.size() - 8));
-		write<uint32_t>(&wavHeader[24], uint32_t(sampleRates.output));
-		write<uint32_t>(&wavHeader[28], uint32_t(sampleRates.output * channelCount * bitsPerSample / 8));
-		write<uint32_t>(&wavHeader[wavHeader.size() - 4], uint32_t(wavData.size()));
+		// pad with silence any frames that were not rendered
+		std::vector<float> silence(channelCount << 10);
+		while (outputFramesWritten < outputFrameCount)
+		{
+			OutputChunk outputChunk{};
+			outputChunk.data = silence.data();
+			outputChunk.frameCount = 1 << 10;
+			outputChunk.channelStride = 1 << 10;
+			writeChunk(outputChunk);
+		}
 
-		outputFile.write(wavHeader.data(), wavHeader.size());
-		outputFile.write(wavData.data(), wavData.size());
+		flushOutput();
+		outputFile.flush();
+		if (!outputFile)
+			fail("Please check your output path: there was a problem writing the output file");
 	}
 
 	template <typename Type>
@@ -303,25 +744,220 @@ struct Processor
 		for (unsigned i = 0; i < sizeof(Type); ++i)
 			data[i] = value >> 8 * i;
 	}
+};
 
-	template <typename Sample>
-	static inline float toFloat(Sample x)
+// Renders the whole output on several threads. The sequence of grains is split into contiguous segments,
+// each rendered by its own Stretcher. Every segment after the first starts with a reset grain followed by
+// preroll grains of real input, so that its phase state has settled by the seam. Each segment but the last
+// renders on past its end seam so that, over the output of fadeGrains grains from each seam, the two
+// neighbouring segments are crossfaded. The two renders are phased independently, so from the first seam
+// onwards output differs from a serial render. Seams are placed at the quietest grain near each nominal
+// split point, where the crossfade is least audible.
+// Each thread writes its output straight to its place in the output file, except for the few grains around
+// each seam, which it holds until both neighbours have rendered them. Memory use is thus independent of
+// the length of the output.
+static void renderParallel(Processor &processor, const Stretcher &stretcher, const Request &initial, int threadCount, ProfileMode profileMode)
+{
+	const int channelCount = processor.channelCount;
+
+	Request hop = initial;
+	hop.position = 0.;
+	stretcher.next(hop);
+	const double inputHop = hop.position;
+	const double outputHop = std::abs(inputHop / initial.speed) * processor.sampleRates.output / processor.sampleRates.input;
+
+	// Grain g is at input position initial.position + g * inputHop. Its output chunk, delayed by the
+	// stretcher's latency, begins near output frame (g - 2) * outputHop. Resampling adds a further delay, so
+	// segments are placed, as Processor::write places chunks, by the request positions of their output.
+	constexpr int prerollGrains = 4;
+	constexpr int latencyGrains = 2;
+	constexpr int fadeGrains = 4;
+	constexpr int tailGrains = 4; // allow for the delay of resampling
+	const int firstGrain = -prerollGrains;
+	const int endGrain = int(std::ceil(processor.outputFrameCount / outputHop)) + latencyGrains + tailGrains;
+	const std::ptrdiff_t fadeFrames = std::llround(fadeGrains * outputHop);
+
+	threadCount = std::max(1, std::min(threadCount, (endGrain - firstGrain) / 32));
+
+	auto energy = [&](int g) {
+		const auto centre = std::llround(initial.position + g * inputHop);
+		const auto radius = std::llround(2 * std::abs(inputHop));
+		const InputChunk inputChunk{int(centre - radius), int(centre + radius)};
+		const auto input = processor.getInputAudio(inputChunk);
+		double sum = 0.;
+		for (int c = 0; c < channelCount; ++c)
+			for (int i = 0; i < inputChunk.end - inputChunk.begin; ++i)
+				sum += input.data[c * input.channelStride + i] * input.data[c * input.channelStride + i];
+		return sum;
+	};
+
+	// The search is narrow enough that seams stay at least 16 grains apart, so that no segment's held grains
+	// around one seam reach those around the next
+	std::vector<int> seams(threadCount + 1);
+	seams.front() = firstGrain;
+	seams.back() = endGrain;
+	const int searchGrains = std::min(16, (endGrain - firstGrain) / threadCount / 4);
+	for (int k = 1; k < threadCount; ++k)
 	{
-		constexpr float k = -1.f / std::numeric_limits<Sample>::min();
-		return k * x;
+		const int nominal = firstGrain + int((endGrain - firstGrain) * (std::int64_t)k / threadCount);
+		seams[k] = nominal;
+		double quietest = energy(nominal);
+		for (int g = nominal - searchGrains; g <= nominal + searchGrains; ++g)
+			if (const double e = energy(g); e < quietest)
+			{
+				quietest = e;
+				seams[k] = g;
+			}
 	}
 
-	template <typename Sample>
-	static inline Sample fromFloat(float x)
+	struct Segment
+	{
+		int beginGrain;
+		int endGrain;
+		std::ptrdiff_t firstFrame{};
+		std::ptrdiff_t headEnd{}; // output frames before this, from firstFrame, are held in head for the crossfade in
+		std::ptrdiff_t tailBegin; // output frames from this on, which the next segment may overlap, are held in tail
+		std::vector<float> head; // interleaved
+		std::vector<float> tail; // interleaved
+	};
+
+	std::vector<Segment> segments(threadCount);
+	for (int k = 0; k < threadCount; ++k)
 	{
-		x = std::ldexp(x, 8 * sizeof(Sample) - 1);
-		x = std::round(x);
-		if (x < std::numeric_limits<Sample>::min())
-			return std::numeric_limits<Sample>::min();
-		if (x >= -(float)std::numeric_limits<Sample>::min())
-			return std::numeric_limits<Sample>::max();
-		return x;
+		segments[k].beginGrain = seams[k];
+		segments[k].endGrain = k + 1 < threadCount ? seams[k + 1] + fadeGrains : seams[k + 1];
+
+		// Early enough to precede the next segment's first frame despite any delay of resampling
+		segments[k].tailBegin = k + 1 < threadCount ? std::llround((seams[k + 1] - latencyGrains - tailGrains) * outputHop) : PTRDIFF_MAX;
 	}
-};
+
+	auto hold = [&](std::vector<float> &audio, const OutputChunk &outputChunk, int f) {
+		for (int c = 0; c < channelCount; ++c)
+			audio.push_back(outputChunk.data[f * outputChunk.frameStride + c * outputChunk.channelStride]);
+	};
+
+	auto render = [&](int k) {
+		auto &segment = segments[k];
+		Stretcher stretcher(processor.sampleRates, channelCount, profileMode);
+		Processor::InputWindow inputWindow(processor);
+		Processor::OutputScratch scratch(processor);
+
+		bool placed = false;
+		std::ptrdiff_t frame = 0; // of the next output chunk
+		const int leadIn = segment.beginGrain == firstGrain ? 0 : prerollGrains;
+		for (int g = segment.beginGrain - leadIn; g < segment.endGrain; ++g)
+		{
+			Request request = initial;
+			request.position = initial.position + g * inputHop;
+			request.reset = g == segment.beginGrain - leadIn;
+
+			const InputChunk inputChunk = stretcher.specifyGrain(request);
+			const auto input = inputWindow(inputChunk);
+			stretcher.analyseGrain(input.data, input.channelStride);
+
+			OutputChunk outputChunk;
+			stretcher.synthesiseGrain(outputChunk);
+
+			const double position = outputChunk.request[OutputChunk::begin]->position;
+			if (g < segment.beginGrain || std::isnan(position))
+				continue;
+
+			// Rounded as Processor::write rounds the preroll that it trims
+			if (!placed)
+			{
+				const double inputFrames = std::round((position - initial.position) * (initial.speed < 0. ? -1. : 1.));
+				const double end = outputChunk.request[OutputChunk::end]->position;
+				frame = segment.firstFrame = std::llround(inputFrames * (outputChunk.frameCount / std::abs(end - position)));
+				segment.headEnd = k ? std::max(segment.firstFrame, segments[k - 1].tailBegin) + fadeFrames : segment.firstFrame;
+				placed = true;
+			}
+
+			int f = 0;
+			for (; f < outputChunk.frameCount && frame + f < segment.headEnd; ++f)
+				hold(segment.head, outputChunk, f);
+
+			const int tail = int(std::clamp<std::ptrdiff_t>(segment.tailBegin - frame, f, outputChunk.frameCount));
+			if (tail > f)
+			{
+				OutputChunk part = outputChunk;
+				part.data += f * outputChunk.frameStride;
+				part.frameCount = tail - f;
+				processor.writeAt(frame + f, part, scratch);
+			}
+
+			for (f = tail; f < outputChunk.frameCount; ++f)
+				hold(segment.tail, outputChunk, f);
+
+			frame += outputChunk.frameCount;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int k = 1; k < threadCount; ++k)
+		threads.emplace_back(render, k);
+	render(0);
+	for (auto &thread : threads)
+		thread.join();
+
+	// Crossfades, at each seam, the tail of the segment before it into the head of the segment after it
+	Processor::OutputScratch scratch(processor);
+	for (int k = 1; k < threadCount; ++k)
+	{
+		const auto &previous = segments[k - 1];
+		const auto &segment = segments[k];
+
+		auto sample = [&](const std::vector<float> &audio, std::ptrdiff_t begin, std::ptrdiff_t o, int c) {
+			const auto i = (o - begin) * channelCount + c;
+			return i >= 0 && i < std::ptrdiff_t(audio.size()) ? double(audio[i]) : 0.;
+		};
+
+		const auto previousEnd = previous.tailBegin + std::ptrdiff_t(previous.tail.size() / channelCount);
+		const auto fadeBegin = std::max(segment.firstFrame, previous.tailBegin);
+		const auto fadeEnd = std::max(fadeBegin, std::min(fadeBegin + fadeFrames, previousEnd));
+
+		// Correlation, clamped to [0, 1], of the two segments over the crossfade
+		double products[3]{};
+		for (auto o = fadeBegin; o < fadeEnd; ++o)
+			for (int c = 0; c < channelCount; ++c)
+			{
+				const double x = sample(previous.tail, previous.tailBegin, o, c);
+				const double y = sample(segment.head, segment.firstFrame, o, c);
+				products[0] += x * y;
+				products[1] += x * x;
+				products[2] += y * y;
+			}
+		double correlation = 0.;
+		if (products[1] > 0. && products[2] > 0.)
+			correlation = std::clamp(products[0] / std::sqrt(products[1] * products[2]), 0., 1.);
+
+		// Gains sin and cos of an angle rising from 0 to pi/2, normalised so that a^2 + b^2 + 2ab * correlation = 1.
+		// The crossfade is thus amplitude-complementary between identical segments, as at unit speed, and
+		// equal-power between segments whose independent phasing decorrelates them.
+		const auto begin = previous.tailBegin;
+		const auto end = std::max(begin, segment.headEnd);
+		std::vector<float> mix((end - begin) * channelCount);
+		for (auto o = begin; o < end; ++o)
+		{
+			const double x = fadeEnd > fadeBegin ? (o - fadeBegin + 0.5) / double(fadeEnd - fadeBegin) : o >= fadeBegin;
+			const double angle = std::numbers::pi / 2 * std::clamp(x, 0., 1.);
+			const double normalisation = std::sqrt(1. + correlation * std::sin(2. * angle));
+			for (int c = 0; c < channelCount; ++c)
+			{
+				const double value = std::cos(angle) * sample(previous.tail, previous.tailBegin, o, c) + std::sin(angle) * sample(segment.head, segment.firstFrame, o, c);
+				mix[(o - begin) * channelCount + c] = float(value / normalisation);
+			}
+		}
+
+		OutputChunk outputChunk{};
+		outputChunk.data = mix.data();
+		outputChunk.frameCount = int(end - begin);
+		outputChunk.frameStride = channelCount;
+		outputChunk.channelStride = 1;
+		processor.writeAt(begin, outputChunk, scratch);
+	}
+
+	// Every frame of the output has been written at its position, so writeOutputFile has nothing to pad
+	processor.outputFramesWritten = processor.outputFrameCount;
+}
 
 } // namespace Bungee::CommandLine
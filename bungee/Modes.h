@@ -14,10 +14,36 @@
 	X_ITEM(Resample, resample, forceIn, "input resampling, always active") \
 	X_END(Resample, resample)
 
+#define BUNGEE_MODES_INTERPOLATION \
+	X_BEGIN(Interpolation, interpolation) \
+	X_ITEM(Interpolation, interpolation, bilinear, "bilinear interpolation when resampling (default)") \
+	X_ITEM(Interpolation, interpolation, sinc8, "8-tap windowed-sinc interpolation when resampling") \
+	X_ITEM(Interpolation, interpolation, sinc16, "16-tap windowed-sinc interpolation when resampling") \
+	X_ITEM(Interpolation, interpolation, sinc32, "32-tap windowed-sinc interpolation when resampling") \
+	X_END(Interpolation, interpolation)
+
 #define BUNGEE_MODES \
 	BUNGEE_MODES_RESAMPLE \
+	BUNGEE_MODES_INTERPOLATION \
 	//
 
+// A profile trades latency against CPU load. Unlike the modes above, which may change from grain to grain
+// through Request, a profile is fixed when a Stretcher is constructed because it sets the grain hop and
+// transform length, and so the stretcher's buffer sizes. Each step halves or doubles both.
+#define BUNGEE_MODES_PROFILE \
+	X_BEGIN(Profile, profile) \
+	X_ITEM(Profile, profile, balanced, "grain hop of 8-16ms, transform of eight hops (default)") \
+	X_ITEM(Profile, profile, lowLatency, "grain hop of 4-8ms, for live monitoring") \
+	X_ITEM(Profile, profile, lowCpu, "grain hop of 16-32ms, for bulk offline processing") \
+	X_END(Profile, profile)
+
+// Like the profile, the pipeline mode is fixed when a Stretcher is constructed
+#define BUNGEE_MODES_PIPELINE \
+	X_BEGIN(Pipeline, pipeline) \
+	X_ITEM(Pipeline, pipeline, sequential, "every grain is processed on the caller's thread (default)") \
+	X_ITEM(Pipeline, pipeline, twoThread, "each grain is analysed on a worker thread while its predecessor is synthesised, output lags by one grain") \
+	X_END(Pipeline, pipeline)
+
 namespace Bungee {
 
 #define X_BEGIN(Type, type) \
@@ -30,6 +56,8 @@ namespace Bungee {
 	;
 
 BUNGEE_MODES
+BUNGEE_MODES_PROFILE
+BUNGEE_MODES_PIPELINE
 
 #undef X_BEGIN
 #undef X_ITEM
@@ -0,0 +1,56 @@
+// Copyright (C) 2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#pragma once
+
+#include "Bungee.h"
+
+namespace Bungee::Pull {
+
+// Bungee::Pull::OutputBuffer is an optional component that assists users of Bungee::Stretcher
+// in applications whose audio callback must produce a fixed number of frames on every call.
+//
+// Each grain emits a chunk of output whose length varies with pitch, resampling and sample rates,
+// so such applications need a FIFO between the stretcher and their callback. This adapter is that
+// FIFO: it drives the granular loop itself, calling back to a Source for input audio and for each
+// grain's Request, and returns exactly blockFrameCount frames on every call of pull().
+//
+// Grain work is spread over successive calls so that the processing cost of each call is as even
+// as possible. Each grain is processed in two halves, analysis and synthesis, and a call performs
+// only as many halves as are needed, on average, to keep pace with its output. The price is latency:
+// the buffer runs up to Stretcher::maxOutputFrameCount() frames ahead of the callback.
+//
+// The constructor allocates; pull() neither allocates nor locks, provided that the Source does not.
+// Example usage may be found in ../cmd/main.cpp.
+//
+struct OutputBuffer
+{
+	// Supplies input audio and grain requests to an OutputBuffer. Its functions are called from within pull().
+	struct Source
+	{
+		virtual ~Source() = default;
+
+		// Returns input audio for the chunk, with sample f of channel c at data[f + c * channelStride].
+		virtual const float *inputAudio(const InputChunk &inputChunk, intptr_t &channelStride) = 0;
+
+		// Called after Stretcher::next has prepared request for the following grain. Override to
+		// adjust request, for example to follow a speed, pitch or position control.
+		virtual void nextRequest(Request &) {}
+	};
+
+	struct Implementation;
+	Implementation *const state;
+
+	// The stretcher and source must outlive the OutputBuffer. The first grain is made with request, which
+	// may first have been prepared with Stretcher::preroll. Output of the grains that fill the stretcher's
+	// pipeline is discarded, so that the first frames pulled are those at the first grain's position.
+	OutputBuffer(Stretcher &stretcher, Source &source, int channelCount, int blockFrameCount, const Request &request);
+	~OutputBuffer();
+
+	int blockFrameCount() const;
+
+	// Writes or adds exactly blockFrameCount frames of output to destination, applying its gain ramp.
+	void pull(const OutputDestination &destination);
+};
+
+} // namespace Bungee::Pull
@@ -0,0 +1,318 @@
+// Copyright (C) 2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+// Times the stretcher's grain functions over a matrix of configurations and reports the results as JSON.
+// Only the public API is called, so the timings are of the pipeline as shipped. In a build configured with
+// BUNGEE_INSTRUMENTATION, the per-stage breakdown is taken from Stretcher::statistics().
+
+#include "bungee/Bungee.h"
+
+#define CXXOPTS_NO_EXCEPTIONS
+#include "cxxopts.hpp"
+#undef CXXOPTS_NO_EXCEPTIONS
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace Bungee;
+
+#define X_BEGIN(Type, type) \
+	const char *name(Type##Mode mode) \
+	{ \
+		switch (mode) \
+		{
+#define X_ITEM(Type, type, mode, description) \
+	case Type##Mode::mode: \
+		return #mode;
+#define X_END(Type, type) \
+	} \
+	return ""; \
+	}
+BUNGEE_MODES
+BUNGEE_MODES_PROFILE
+BUNGEE_MODES_PIPELINE
+#undef X_BEGIN
+#undef X_ITEM
+#undef X_END
+
+enum Call
+{
+	specifyGrain,
+	analyseGrain,
+	synthesiseGrain,
+	callCount
+};
+
+constexpr const char *callNames[callCount] = {
+	"specifyGrain",
+	"analyseGrain",
+	"synthesiseGrain",
+};
+
+constexpr const char *stageNames[Statistics::stageCount] = {
+	"analysis",
+	"forwardTransform",
+	"synthesis",
+	"inverseTransform",
+	"resample",
+};
+
+struct Case
+{
+	int sampleRate;
+	int channelCount;
+	double speed;
+	double semitones;
+	ResampleMode resampleMode;
+	InterpolationMode interpolationMode;
+	ProfileMode profileMode;
+	PipelineMode pipelineMode;
+};
+
+struct Result
+{
+	Case configuration;
+	int grainCount;
+	std::array<double, callCount> nanoseconds{};
+	std::array<double, Statistics::stageCount> ticks{}; // from Stretcher::statistics(), zero unless instrumented
+	double outputSeconds{};
+
+	double total() const
+	{
+		double sum = 0.;
+		for (auto t : nanoseconds)
+			sum += t;
+		return sum;
+	}
+};
+
+Result measure(const Case &configuration, int grainCount)
+{
+	constexpr int warmUpGrains = 8;
+
+	const SampleRates sampleRates{configuration.sampleRate, configuration.sampleRate};
+	const int channelCount = configuration.channelCount;
+
+	Stretcher stretcher(sampleRates, channelCount, configuration.profileMode, configuration.pipelineMode);
+
+	Request request{};
+	request.speed = configuration.speed;
+	request.pitch = std::pow(2., configuration.semitones / 12);
+	request.resampleMode = configuration.resampleMode;
+	request.interpolationMode = configuration.interpolationMode;
+
+	Request hop = request;
+	hop.position = 0.;
+	stretcher.next(hop);
+
+	// Input is noise plus a few tones, long enough that no grain reaches beyond either end
+	const int padding = stretcher.maxInputFrameCount();
+	const int span = int(std::ceil(std::abs(hop.position) * (grainCount + warmUpGrains + 8)));
+	const int stride = padding + span + padding;
+	std::vector<float> audio(std::size_t(stride) * channelCount);
+	std::minstd_rand random(channelCount);
+	std::uniform_real_distribution<float> noise(-.05f, .05f);
+	for (int c = 0; c < channelCount; ++c)
+		for (int i = 0; i < stride; ++i)
+		{
+			float x = noise(random);
+			for (int k = 1; k <= 3; ++k)
+				x += .2f * std::sin(i * (.01f * k + .003f * c));
+			audio[c * std::size_t(stride) + i] = x;
+		}
+
+	const int origin = padding;
+	request.position = configuration.speed < 0. ? span : 0.;
+	stretcher.preroll(request);
+
+	Result result{configuration, grainCount};
+	Statistics before{};
+	for (int g = -warmUpGrains; g < grainCount; ++g)
+	{
+		using Clock = std::chrono::steady_clock;
+		std::array<Clock::time_point, callCount + 1> t;
+
+		if (g == 0)
+			before = stretcher.statistics();
+
+		// With BUNGEE_REALTIME_AUDIT, any allocation or locking by the grain functions aborts the benchmark
+		t[specifyGrain] = Clock::now();
+		const InputChunk inputChunk = stretcher.specifyGrain(request);
+
+		t[analyseGrain] = Clock::now();
+		if (origin + inputChunk.begin < 0 || origin + inputChunk.end > stride)
+			std::abort();
+		const float *data = inputChunk.begin == inputChunk.end ? nullptr : &audio[origin + inputChunk.begin];
+		stretcher.analyseGrain(data, stride);
+
+		t[synthesiseGrain] = Clock::now();
+		OutputChunk outputChunk;
+		stretcher.synthesiseGrain(outputChunk);
+
+		t[callCount] = Clock::now();
+
+		stretcher.next(request);
+
+		if (g >= 0)
+		{
+			for (int c = 0; c < callCount; ++c)
+				result.nanoseconds[c] += std::chrono::duration<double, std::nano>(t[c + 1] - t[c]).count();
+			result.outputSeconds += double(outputChunk.frameCount) / sampleRates.output;
+		}
+	}
+
+	const Statistics after = stretcher.statistics();
+	for (int s = 0; s < Statistics::stageCount; ++s)
+		result.ticks[s] = double(after.ticks[s] - before.ticks[s]) / grainCount;
+
+	for (auto &t : result.nanoseconds)
+		t /= grainCount;
+
+	return result;
+}
+
+void write(std::ostream &os, const Result &result, bool last)
+{
+	const auto &c = result.configuration;
+	const double total = result.total();
+	const double seconds = total * result.grainCount * 1e-9;
+
+	os << "    {\n";
+	os << "      \"sampleRate\": " << c.sampleRate << ",\n";
+	os << "      \"channelCount\": " << c.channelCount << ",\n";
+	os << "      \"speed\": " << c.speed << ",\n";
+	os << "      \"pitchSemitones\": " << c.semitones << ",\n";
+	os << "      \"resampleMode\": \"" << name(c.resampleMode) << "\",\n";
+	os << "      \"interpolationMode\": \"" << name(c.interpolationMode) << "\",\n";
+	os << "      \"profileMode\": \"" << name(c.profileMode) << "\",\n";
+	os << "      \"pipelineMode\": \"" << name(c.pipelineMode) << "\",\n";
+	os << "      \"grainCount\": " << result.grainCount << ",\n";
+	os << "      \"nsPerGrain\": {";
+	for (int s = 0; s < callCount; ++s)
+		os << "\"" << callNames[s] << "\": " << result.nanoseconds[s] << ", ";
+	os << "\"total\": " << total << "},\n";
+#if BUNGEE_INSTRUMENTATION
+	os << "      \"ticksPerGrain\": {";
+	for (int s = 0; s < Statistics::stageCount; ++s)
+		os << "\"" << stageNames[s] << "\": " << result.ticks[s] << (s + 1 < Statistics::stageCount ? ", " : "");
+	os << "},\n";
+#endif
+	os << "      \"grainsPerSecondPerCore\": " << 1e9 / total << ",\n";
+	os << "      \"realTimeFactor\": " << result.outputSeconds / seconds << "\n";
+	os << "    }" << (last ? "" : ",") << "\n";
+}
+
+} // namespace
+
+int main(int argc, const char *argv[])
+{
+	cxxopts::Options options("bungee_benchmark", std::string("Bungee stage timing benchmark\n\nVersion: ") + Bungee::version() + "\n");
+	options.add_options() //
+		("rates", "sample rates, Hz", cxxopts::value<std::vector<int>>()->default_value("8000,44100,48000,96000,192000")) //
+		("channels", "channel counts", cxxopts::value<std::vector<int>>()->default_value("1,2,16")) //
+		("speeds", "speeds, as multiples of input speed", cxxopts::value<std::vector<double>>()->default_value("1,0.5,1.5,0,-1")) //
+		("pitches", "pitch shifts, semitones", cxxopts::value<std::vector<double>>()->default_value("0,7")) //
+		("resample", "resample modes", cxxopts::value<std::vector<std::string>>()->default_value("autoOut,autoIn")) //
+		("interpolation", "interpolation modes", cxxopts::value<std::vector<std::string>>()->default_value("bilinear")) //
+		("profile", "profile modes", cxxopts::value<std::vector<std::string>>()->default_value("balanced")) //
+		("pipeline", "pipeline modes", cxxopts::value<std::vector<std::string>>()->default_value("sequential")) //
+		("grains", "grains timed per configuration", cxxopts::value<int>()->default_value("100")) //
+		("o,output", "JSON output filename, or - for standard output", cxxopts::value<std::string>()->default_value("-")) //
+		("h,help", "display this message") //
+		;
+	const auto parameters = options.parse(argc, argv);
+	if (parameters.count("help"))
+	{
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	std::vector<ResampleMode> resampleModes;
+	std::vector<InterpolationMode> interpolationModes;
+	std::vector<ProfileMode> profileModes;
+	std::vector<PipelineMode> pipelineModes;
+#define X_BEGIN(Type, type) \
+	for (const auto &mode : parameters[#type].as<std::vector<std::string>>()) \
+	{ \
+		bool found = false;
+#define X_ITEM(Type, type, m, description) \
+	if (mode == #m) \
+	{ \
+		type##Modes.push_back(Type##Mode::m); \
+		found = true; \
+	}
+#define X_END(Type, type) \
+	if (!found) \
+	{ \
+		std::cerr << "unrecognised " #type " mode: " << mode << "\n"; \
+		return 1; \
+	} \
+	}
+	BUNGEE_MODES
+	BUNGEE_MODES_PROFILE
+	BUNGEE_MODES_PIPELINE
+#undef X_BEGIN
+#undef X_ITEM
+#undef X_END
+
+	const int grainCount = parameters["grains"].as<int>();
+	if (grainCount < 1)
+	{
+		std::cerr << "grains must be positive\n";
+		return 1;
+	}
+
+	std::vector<Case> cases;
+	for (auto sampleRate : parameters["rates"].as<std::vector<int>>())
+		for (auto channelCount : parameters["channels"].as<std::vector<int>>())
+			for (auto speed : parameters["speeds"].as<std::vector<double>>())
+				for (auto semitones : parameters["pitches"].as<std::vector<double>>())
+					for (auto resampleMode : resampleModes)
+						for (auto interpolationMode : interpolationModes)
+							for (auto profileMode : profileModes)
+								for (auto pipelineMode : pipelineModes)
+								{
+									if (sampleRate < 8000 || sampleRate > 192000 || channelCount < 1 || std::abs(speed) > 100. || std::abs(semitones) > 48.)
+									{
+										std::cerr << "configuration out of range\n";
+										return 1;
+									}
+									cases.push_back({sampleRate, channelCount, speed, semitones, resampleMode, interpolationMode, profileMode, pipelineMode});
+								}
+
+	const auto filename = parameters["output"].as<std::string>();
+	std::ofstream file;
+	if (filename != "-")
+	{
+		file.open(filename);
+		if (!file)
+		{
+			std::cerr << "could not open output file\n";
+			return 1;
+		}
+	}
+	std::ostream &os = filename == "-" ? std::cout : file;
+
+	os << "{\n";
+	os << "  \"version\": \"" << Bungee::version() << "\",\n";
+	os << "  \"results\": [\n";
+	for (std::size_t i = 0; i < cases.size(); ++i)
+	{
+		write(os, measure(cases[i], grainCount), i + 1 == cases.size());
+		os.flush();
+	}
+	os << "  ]\n";
+	os << "}\n";
+
+	return 0;
+}
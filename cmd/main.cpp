@@ -4,6 +4,7 @@
 #include "bungee/../src/log2.h"
 #include "bungee/Bungee.h"
 #include "bungee/CommandLine.h"
+#include "bungee/Pull.h"
 
 int main(int argc, const char *argv[])
 {
@@ -17,19 +18,30 @@ int main(int argc, const char *argv[])
 	CommandLine::Parameters parameters{options, argc, argv, request};
 	CommandLine::Processor processor{parameters, request};
 
-	Stretcher stretcher(processor.sampleRates, processor.channelCount);
+	Stretcher stretcher(processor.sampleRates, processor.channelCount, parameters.profileMode, parameters.pipelineMode);
 
 	processor.restart(request);
-	stretcher.preroll(request);
 
+	const int threadCount = parameters["threads"].as<int>();
 	const int pushFrameCount = parameters["push"].as<int>();
-	if (pushFrameCount)
+	const int blockFrameCount = parameters["block"].as<int>();
+	if (threadCount > 1 && request.speed != 0.)
+	{
+		// Offline rendering: segments of the timeline are rendered concurrently, each by its own Stretcher.
+
+		std::cout << "Rendering on " << threadCount << " threads\n";
+
+		CommandLine::renderParallel(processor, stretcher, request, threadCount, parameters.profileMode);
+	}
+	else if (pushFrameCount)
 	{
 		// This code exists only to demonstrate the usage of the Bungee stretcher with the Push::InputBuffer
 		// See the else part of the code for an example of the native "pull" API.
 
 		std::cout << "Using Push::InputBuffer with " << pushFrameCount << " frames per push\n";
 
+		stretcher.preroll(request);
+
 		InputChunk inputChunk = stretcher.specifyGrain(request);
 
 		Push::InputBuffer pushInputBuffer(stretcher.maxInputFrameCount() + pushFrameCount, processor.channelCount);
@@ -62,17 +74,63 @@ int main(int argc, const char *argv[])
 			}
 		}
 	}
+	else if (blockFrameCount)
+	{
+		// This code exists only to demonstrate the usage of the Bungee stretcher with the Pull::OutputBuffer,
+		// as would be driven by an audio callback that must produce a fixed number of frames.
+
+		std::cout << "Using Pull::OutputBuffer with " << blockFrameCount << " frames per block\n";
+
+		struct Source : Pull::OutputBuffer::Source
+		{
+			CommandLine::Processor &processor;
+
+			Source(CommandLine::Processor &processor) :
+				processor(processor)
+			{
+			}
+
+			const float *inputAudio(const InputChunk &inputChunk, intptr_t &channelStride) override
+			{
+				const auto input = processor.getInputAudio(inputChunk);
+				channelStride = input.channelStride;
+				return input.data;
+			}
+		} source{processor};
+
+		Pull::OutputBuffer outputBuffer(stretcher, source, processor.channelCount, blockFrameCount, request);
+
+		std::vector<float> block(std::size_t(blockFrameCount) * processor.channelCount);
+		const OutputDestination destination{block.data(), 1, processor.channelCount, false, {1.f, 1.f}};
+
+		for (bool done = false; !done;)
+		{
+			outputBuffer.pull(destination);
+
+			OutputChunk outputChunk{};
+			outputChunk.data = block.data();
+			outputChunk.frameCount = blockFrameCount;
+			outputChunk.channelStride = 1;
+			outputChunk.frameStride = processor.channelCount;
+			done = processor.writeChunk(outputChunk);
+		}
+	}
 	else
 	{
 		// Regular pull API
 
+		stretcher.preroll(request);
+
 		for (bool done = false; !done;)
 		{
 			InputChunk inputChunk = stretcher.specifyGrain(request);
 
-			stretcher.analyseGrain(processor.getInputAudio(inputChunk), processor.inputChannelStride);
+			const auto input = processor.getInputAudio(inputChunk);
+			stretcher.analyseGrain(input.data, input.channelStride);
+
+			// WAV audio is interleaved, so have the stretcher interleave its output
 			OutputChunk outputChunk;
-			stretcher.synthesiseGrain(outputChunk);
+			stretcher.synthesiseGrainInterleaved(outputChunk);
 
 			stretcher.next(request);
 
@@ -0,0 +1,244 @@
+// Copyright (C) 2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#include "AnalysisCache.h"
+#include "Assert.h"
+#include "Fourier.h"
+#include "Timing.h"
+
+#include <bit>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BUNGEE_ANALYSIS_CACHE_MAPPED 1
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Bungee {
+
+namespace {
+
+constexpr std::size_t alignment = 64;
+constexpr std::uint32_t fileVersion = 1;
+
+constexpr std::size_t aligned(std::size_t bytes)
+{
+	return (bytes + alignment - 1) / alignment * alignment;
+}
+
+#ifdef BUNGEE_ANALYSIS_CACHE_MAPPED
+// Maps the sidecar file at path, reinitialising it unless it begins with header. The file is locked so that no other
+// process can map it while fd, which is returned open, remains so. Returns nullptr if the file cannot be opened,
+// locked or mapped.
+char *mapFile(const char *path, const AnalysisCache::Implementation::FileHeader &header, std::size_t bytes, int &fd)
+{
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return nullptr;
+
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+	{
+		close(fd);
+		fd = -1;
+		return nullptr;
+	}
+
+	AnalysisCache::Implementation::FileHeader existing{};
+	struct stat status;
+	const bool valid = fstat(fd, &status) == 0 && std::size_t(status.st_size) == bytes &&
+		pread(fd, &existing, sizeof(existing), 0) == ssize_t(sizeof(existing)) && existing == header;
+
+	bool ok = valid || (ftruncate(fd, 0) == 0 && ftruncate(fd, off_t(bytes)) == 0);
+
+	void *mapped = MAP_FAILED;
+	if (ok)
+		mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (mapped == MAP_FAILED)
+	{
+		close(fd);
+		fd = -1;
+		return nullptr;
+	}
+
+	// The header is written last so that an interrupted initialisation is detected when the file is next opened
+	if (!valid)
+		std::memcpy(mapped, &header, sizeof(header));
+
+	return static_cast<char *>(mapped);
+}
+#endif
+
+} // namespace
+
+AnalysisCache::AnalysisCache(SampleRates sampleRates, int channelCount, int grainCount, const char *path, ProfileMode profileMode) :
+	state(new Implementation(sampleRates, channelCount, grainCount, path, profileMode))
+{
+}
+
+AnalysisCache::~AnalysisCache()
+{
+	delete state;
+}
+
+bool AnalysisCache::persistent() const
+{
+	return state->mappedBytes;
+}
+
+void AnalysisCache::clear()
+{
+	state->clear();
+}
+
+AnalysisCache::Implementation::Implementation(SampleRates sampleRates, int channelCount, int grainCount, const char *path, ProfileMode profileMode) :
+	channelCount(channelCount),
+	log2TransformLength(Timing(sampleRates, profileMode).log2SynthesisHop + 3),
+	slotCount((std::max(grainCount, 2) + 1) & ~1),
+	slotBytes(partialsOffset() + aligned(Fourier::binCount(log2TransformLength) * sizeof(Partials::Partial)))
+{
+	BUNGEE_ASSERT1(channelCount > 0);
+	BUNGEE_ASSERT1(grainCount > 0);
+
+	const std::size_t bytes = aligned(sizeof(FileHeader)) + slotCount * slotBytes;
+
+#ifdef BUNGEE_ANALYSIS_CACHE_MAPPED
+	if (path)
+	{
+		FileHeader header{{'B', 'u', 'n', 'g', 'e', 'e', 'A', 'C'}, fileVersion, sampleRates.input, channelCount, log2TransformLength, slotCount, slotBytes};
+		if (auto mapped = mapFile(path, header, bytes, fd))
+		{
+			mappedBytes = bytes;
+			slots = mapped + aligned(sizeof(FileHeader));
+			return;
+		}
+	}
+#endif
+
+	heap = static_cast<char *>(::operator new(bytes, std::align_val_t(alignment)));
+	slots = heap + aligned(sizeof(FileHeader));
+	clear();
+}
+
+AnalysisCache::Implementation::~Implementation()
+{
+#ifdef BUNGEE_ANALYSIS_CACHE_MAPPED
+	if (mappedBytes)
+	{
+		munmap(slots - aligned(sizeof(FileHeader)), mappedBytes);
+		close(fd);
+	}
+#endif
+	if (heap)
+		::operator delete(heap, std::align_val_t(alignment));
+}
+
+// Each slot holds an Entry, then rows [0, binCount) of transformed for every channel, then energy, phase and partials
+std::size_t AnalysisCache::Implementation::transformedOffset() const
+{
+	return aligned(sizeof(Entry));
+}
+
+std::size_t AnalysisCache::Implementation::energyOffset() const
+{
+	return transformedOffset() + aligned(Fourier::binCount(log2TransformLength) * channelCount * sizeof(std::complex<float>));
+}
+
+std::size_t AnalysisCache::Implementation::phaseOffset() const
+{
+	return energyOffset() + aligned(Fourier::binCount(log2TransformLength) * sizeof(float));
+}
+
+std::size_t AnalysisCache::Implementation::partialsOffset() const
+{
+	return phaseOffset() + aligned(Fourier::binCount(log2TransformLength) * sizeof(Phase::Type));
+}
+
+AnalysisCache::Implementation::Key AnalysisCache::Implementation::key(const Grain &grain, int log2WindowLength)
+{
+	Key key{grain.inputChunk.begin, grain.inputChunk.end, grain.requiredBinCount(), 0, 0, 0};
+	if (grain.resampleOperations.input.function)
+	{
+		key.interpolationMode = int(grain.request.interpolationMode);
+		key.inputRatio = std::bit_cast<std::uint32_t>(grain.resampleOperations.input.ratio);
+		key.inputOffset = std::bit_cast<std::uint32_t>(grain.inputResampleOffset(log2WindowLength));
+	}
+	return key;
+}
+
+// A key may occupy either slot of a pair. Of an occupied pair, a new key displaces the entry chosen by a further bit of hash.
+AnalysisCache::Implementation::Entry *AnalysisCache::Implementation::find(const Key &key)
+{
+	// Every field that Key's operator== compares is hashed, so that keys differing in any one are spread over sets
+	std::uint64_t hash = std::uint32_t(key.begin) ^ std::uint64_t(std::uint32_t(key.end)) << 32;
+	hash = (hash ^ std::uint32_t(key.validBinCount) ^ std::uint64_t(std::uint32_t(key.interpolationMode)) << 32) * 0x9e3779b97f4a7c15ull;
+	hash = (hash ^ key.inputRatio ^ std::uint64_t(key.inputOffset) << 32) * 0x9e3779b97f4a7c15ull;
+
+	const auto pair = (hash >> 32) % (slotCount / 2);
+	Entry *entries[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		entries[i] = reinterpret_cast<Entry *>(slots + (2 * pair + i) * slotBytes);
+		if (hit(entries[i], key))
+			return entries[i];
+	}
+
+	if (!entries[0]->occupied || !entries[1]->occupied)
+		return entries[0]->occupied ? entries[1] : entries[0];
+
+	return entries[hash >> 31 & 1];
+}
+
+void AnalysisCache::Implementation::load(const Entry *entry, Grain &grain) const
+{
+	BUNGEE_ASSERT1(grain.log2TransformLength == log2TransformLength);
+
+	const auto binCount = Fourier::binCount(log2TransformLength);
+	const int validBinCount = entry->key.validBinCount;
+
+	auto transformed = reinterpret_cast<const std::complex<float> *>(at(entry, transformedOffset()));
+	for (int c = 0; c < channelCount; ++c)
+	{
+		std::memcpy(&grain.transformed(0, c), transformed + c * binCount, validBinCount * sizeof(std::complex<float>));
+		grain.transformed.col(c).segment(validBinCount, binCount - validBinCount).setZero();
+	}
+	std::memcpy(grain.energy.data(), at(entry, energyOffset()), validBinCount * sizeof(float));
+	std::memcpy(grain.phase.data(), at(entry, phaseOffset()), validBinCount * sizeof(Phase::Type));
+	std::memcpy(grain.partials.array, at(entry, partialsOffset()), entry->partialCount * sizeof(Partials::Partial));
+
+	grain.validBinCount = validBinCount;
+	grain.partials.count = entry->partialCount;
+}
+
+void AnalysisCache::Implementation::store(Entry *entry, const Key &key, const Grain &grain)
+{
+	BUNGEE_ASSERT1(grain.validBinCount == key.validBinCount);
+
+	const auto binCount = Fourier::binCount(log2TransformLength);
+
+	std::atomic_ref(entry->occupied).store(0, std::memory_order_relaxed);
+
+	auto transformed = reinterpret_cast<std::complex<float> *>(at(entry, transformedOffset()));
+	for (int c = 0; c < channelCount; ++c)
+		std::memcpy(transformed + c * binCount, &grain.transformed(0, c), key.validBinCount * sizeof(std::complex<float>));
+	std::memcpy(at(entry, energyOffset()), grain.energy.data(), key.validBinCount * sizeof(float));
+	std::memcpy(at(entry, phaseOffset()), grain.phase.data(), key.validBinCount * sizeof(Phase::Type));
+	std::memcpy(at(entry, partialsOffset()), grain.partials.array, grain.partials.count * sizeof(Partials::Partial));
+
+	entry->key = key;
+	entry->partialCount = grain.partials.count;
+	std::atomic_ref(entry->occupied).store(1, std::memory_order_release);
+}
+
+void AnalysisCache::Implementation::clear()
+{
+	for (std::size_t i = 0; i < slotCount; ++i)
+		reinterpret_cast<Entry *>(slots + i * slotBytes)->occupied = 0;
+}
+
+} // namespace Bungee
@@ -0,0 +1,100 @@
+// Copyright (C) 2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#pragma once
+
+#include "Grain.h"
+
+#include "bungee/Bungee.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Bungee {
+
+// A two-way set-associative table of fixed-size slots, each holding one grain's analysis: the bins that survive output
+// resampling of its transform, energy and phase, and its partials before transient suppression.
+// The table is held in heap memory or in a memory-mapped sidecar file that persists it between sessions.
+struct AnalysisCache::Implementation
+{
+	// Everything other than the input audio itself on which a grain's analysis depends
+	struct Key
+	{
+		std::int32_t begin, end; // the grain's InputChunk
+		std::int32_t validBinCount;
+		std::int32_t interpolationMode; // the following are zero unless input resampling is active
+		std::uint32_t inputRatio; // bits of the float
+		std::uint32_t inputOffset; // bits of the float
+
+		bool operator==(const Key &) const = default;
+	};
+
+	struct Entry
+	{
+		Key key;
+		std::int32_t partialCount;
+		std::uint32_t occupied;
+	};
+
+	// Leads a sidecar file so that a file written with a different configuration is recognised and reinitialised
+	struct FileHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::int32_t inputSampleRate;
+		std::int32_t channelCount;
+		std::int32_t log2TransformLength;
+		std::uint64_t slotCount;
+		std::uint64_t slotBytes;
+
+		bool operator==(const FileHeader &) const = default;
+	};
+
+	const int channelCount;
+	const int log2TransformLength;
+	const std::size_t slotCount;
+	const std::size_t slotBytes;
+	char *slots;
+	std::size_t mappedBytes = 0; // nonzero if slots lies within a mapped file
+	int fd = -1; // of the mapped file, held open to keep its lock
+	char *heap = nullptr;
+
+	Implementation(SampleRates sampleRates, int channelCount, int grainCount, const char *path, ProfileMode profileMode);
+	~Implementation();
+
+	Implementation(const Implementation &) = delete;
+	Implementation &operator=(const Implementation &) = delete;
+
+	static Key key(const Grain &grain, int log2WindowLength);
+
+	// The slot in which the grain with the given key is, or would be, held
+	Entry *find(const Key &key);
+
+	// The acquire pairs with store's release so that an occupied entry's payload is complete
+	static bool hit(Entry *entry, const Key &key)
+	{
+		return std::atomic_ref(entry->occupied).load(std::memory_order_acquire) && entry->key == key;
+	}
+
+	// Copies the entry's analysis into the grain, which must have been specified with the entry's key
+	void load(const Entry *entry, Grain &grain) const;
+
+	// Overwrites the entry with an analysed grain's analysis, before its transient partials are suppressed
+	void store(Entry *entry, const Key &key, const Grain &grain);
+
+	void clear();
+
+private:
+	char *at(const Entry *entry, std::size_t offset) const
+	{
+		return (char *)entry + offset;
+	}
+
+	std::size_t transformedOffset() const;
+	std::size_t energyOffset() const;
+	std::size_t phaseOffset() const;
+	std::size_t partialsOffset() const;
+};
+
+} // namespace Bungee
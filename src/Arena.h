@@ -0,0 +1,82 @@
+// Copyright (C) 2020-2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#pragma once
+
+#include "Assert.h"
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace Bungee {
+
+// Carves cache-line-aligned blocks out of one contiguous piece of memory so that a stretcher's
+// state is compact and its construction makes no heap allocations.
+// An Arena constructed without memory instead allocates each block from the heap and tallies
+// the total size required: it can be used to measure how much memory an object graph needs.
+struct Arena
+{
+	static constexpr std::size_t alignment = 64;
+
+	char *const memory;
+	std::size_t size = 0;
+	std::vector<void *> blocks;
+
+	Arena(void *memory = nullptr) :
+		memory(memory ? align(static_cast<char *>(memory)) : nullptr)
+	{
+	}
+
+	~Arena()
+	{
+		for (auto block : blocks)
+			::operator delete(block, std::align_val_t(alignment));
+	}
+
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	// Number of bytes that should be provided to an Arena that is to hold everything allocated by this one
+	std::size_t required() const
+	{
+		return size + alignment - 1;
+	}
+
+	void *allocate(std::size_t bytes)
+	{
+		size = (size + alignment - 1) / alignment * alignment;
+
+		void *block;
+		if (memory)
+			block = memory + size;
+		else
+			block = blocks.emplace_back(::operator new(bytes ? bytes : 1, std::align_val_t(alignment)));
+
+		size += bytes;
+		return block;
+	}
+
+	template <class T>
+	T *allocate(std::size_t count)
+	{
+		return static_cast<T *>(allocate(count * sizeof(T)));
+	}
+
+	template <class Array>
+	Eigen::Map<Array> array(Eigen::Index rows, Eigen::Index cols)
+	{
+		return Eigen::Map<Array>(allocate<typename Array::Scalar>(rows * cols), rows, cols);
+	}
+
+private:
+	static char *align(char *p)
+	{
+		return p + (-reinterpret_cast<std::uintptr_t>(p) & (alignment - 1));
+	}
+};
+
+} // namespace Bungee
@@ -6,6 +6,16 @@
 #include <csignal>
 #include <iostream>
 
+#if BUNGEE_REALTIME_AUDIT
+#	include <algorithm>
+#	include <cerrno>
+#	include <cstddef>
+#	include <new>
+#	ifdef _WIN32
+#		include <malloc.h>
+#	endif
+#endif
+
 namespace Bungee::Assert {
 
 #ifndef BUNGEE_ASSERT_FAIL_EXTERNAL
@@ -45,4 +55,236 @@ FloatingPointExceptions::~FloatingPointExceptions()
 }
 #endif
 
+#if BUNGEE_REALTIME_AUDIT
+#	if defined(__GNUC__) && !defined(_WIN32)
+// Initial-exec TLS is resolved without calling into the allocator, which matters because malloc consults it
+#		define BUNGEE_REALTIME_TLS __attribute__((tls_model("initial-exec")))
+#	else
+#		define BUNGEE_REALTIME_TLS
+#	endif
+
+namespace {
+thread_local int depth BUNGEE_REALTIME_TLS;
+thread_local bool reporting BUNGEE_REALTIME_TLS;
+} // namespace
+
+RealTime::RealTime()
+{
+	++depth;
+}
+
+RealTime::~RealTime()
+{
+	--depth;
+}
+
+void RealTime::check(const char *operation)
+{
+	if (depth > 0 && !reporting)
+	{
+		// Reporting may itself allocate, so violations are not checked while one is being reported
+		reporting = true;
+		fail(1, operation, __FILE__, __LINE__);
+		reporting = false;
+	}
+}
+#endif
+
 } // namespace Bungee::Assert
+
+#if BUNGEE_REALTIME_AUDIT
+namespace {
+
+void *allocate(std::size_t size, std::size_t alignment) noexcept
+{
+	Bungee::Assert::RealTime::check("heap allocation within a RealTime section");
+	if (!size)
+		size = 1;
+#	ifdef _WIN32
+	return _aligned_malloc(size, std::max(alignment, alignof(std::max_align_t)));
+#	else
+	if (alignment <= alignof(std::max_align_t))
+		return std::malloc(size);
+	void *p;
+	return posix_memalign(&p, alignment, size) ? nullptr : p;
+#	endif
+}
+
+void *allocateOrThrow(std::size_t size, std::size_t alignment)
+{
+	if (auto p = allocate(size, alignment))
+		return p;
+	throw std::bad_alloc();
+}
+
+void release(void *p) noexcept
+{
+	if (!p)
+		return;
+	Bungee::Assert::RealTime::check("heap deallocation within a RealTime section");
+#	ifdef _WIN32
+	_aligned_free(p);
+#	else
+	std::free(p);
+#	endif
+}
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+	return allocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void *operator new[](std::size_t size)
+{
+	return allocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+	return allocateOrThrow(size, std::size_t(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return allocateOrThrow(size, std::size_t(alignment));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return allocate(size, std::size_t(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return allocate(size, std::size_t(alignment));
+}
+
+void operator delete(void *p) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	release(p);
+}
+
+#	ifdef __GLIBC__
+// Interposes glibc's malloc family so that allocations that bypass operator new, such as Eigen's, are caught too
+extern "C" {
+void *__libc_malloc(std::size_t);
+void *__libc_calloc(std::size_t, std::size_t);
+void *__libc_realloc(void *, std::size_t);
+void *__libc_memalign(std::size_t, std::size_t);
+void __libc_free(void *);
+
+void *malloc(std::size_t size)
+{
+	Bungee::Assert::RealTime::check("malloc within a RealTime section");
+	return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size)
+{
+	Bungee::Assert::RealTime::check("calloc within a RealTime section");
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, std::size_t size)
+{
+	Bungee::Assert::RealTime::check("realloc within a RealTime section");
+	return __libc_realloc(p, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size)
+{
+	Bungee::Assert::RealTime::check("memalign within a RealTime section");
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size)
+{
+	Bungee::Assert::RealTime::check("aligned_alloc within a RealTime section");
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, std::size_t alignment, std::size_t size)
+{
+	Bungee::Assert::RealTime::check("posix_memalign within a RealTime section");
+	if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void *))
+		return EINVAL;
+	*p = __libc_memalign(alignment, size);
+	return *p ? 0 : ENOMEM;
+}
+
+void free(void *p)
+{
+	if (p)
+		Bungee::Assert::RealTime::check("free within a RealTime section");
+	__libc_free(p);
+}
+}
+#	endif
+#endif
@@ -14,6 +14,11 @@
 // #define BUNGEE_SELF_TEST 2 // all checks
 #endif
 
+#ifndef BUNGEE_REALTIME_AUDIT
+#	define BUNGEE_REALTIME_AUDIT 0 // no interception
+// #define BUNGEE_REALTIME_AUDIT 1 // abort on heap allocation or mutex locking within a RealTime section
+#endif
+
 namespace Bungee::Assert {
 
 static constexpr int level = BUNGEE_SELF_TEST;
@@ -58,6 +63,26 @@ struct FloatingPointExceptions
 #endif
 };
 
+// Marks a scope, such as a grain function, that must neither touch the heap nor lock a mutex.
+// When BUNGEE_REALTIME_AUDIT is set, the library replaces the global allocation functions (and, with glibc,
+// the malloc family) and these fail loudly if called on a thread that is within such a scope.
+// The library's own mutexes call check() before locking.
+struct RealTime
+{
+#if BUNGEE_REALTIME_AUDIT
+	RealTime();
+	~RealTime();
+
+	RealTime(const RealTime &) = delete;
+	RealTime &operator=(const RealTime &) = delete;
+
+	static void check(const char *operation);
+#else
+	inline RealTime() {}
+	static inline void check(const char *) {}
+#endif
+};
+
 static constexpr auto active = BUNGEE_SELF_TEST == 2;
 
 } // namespace Bungee::Assert
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "Fourier.h"
 #include "Assert.h"
+#include "Radix4.h"
 
 #include "kissfft/kiss_fftr.h"
 
@@ -22,8 +23,8 @@ struct Kiss
 	{
 		Kernel(int log2TransformLength);
 
-		void forward(int log2TransformLength, float *t, std::complex<float> *f) const;
-		void inverse(int log2TransformLength, float *t, std::complex<float> *f) const;
+		void forward(int log2TransformLength, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const;
+		void inverse(int log2TransformLength, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const;
 	};
 
 	typedef Kernel<false> Forward;
@@ -42,22 +43,60 @@ Kiss::KernelBase::~KernelBase()
 }
 
 template <bool isInverse>
-void Kiss::Kernel<isInverse>::forward(int, float *t, std::complex<float> *f) const
+void Kiss::Kernel<isInverse>::forward(int, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const
 {
 	static_assert(sizeof(*f) == sizeof(kiss_fft_cpx));
 	BUNGEE_ASSERT1(!isInverse);
-	kiss_fftr((kiss_fftr_cfg)implementation, t, (kiss_fft_cpx *)f);
+	for (int c = 0; c < channelCount; ++c)
+		kiss_fftr((kiss_fftr_cfg)implementation, t + c * tStride, (kiss_fft_cpx *)(f + c * fStride));
 }
 
 template <bool isInverse>
-void Kiss::Kernel<isInverse>::inverse(int, float *t, std::complex<float> *f) const
+void Kiss::Kernel<isInverse>::inverse(int, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const
 {
 	static_assert(sizeof(*f) == sizeof(kiss_fft_cpx));
 	BUNGEE_ASSERT1(isInverse);
-	kiss_fftri((kiss_fftr_cfg)implementation, (kiss_fft_cpx *)f, t);
+	for (int c = 0; c < channelCount; ++c)
+		kiss_fftri((kiss_fftr_cfg)implementation, (kiss_fft_cpx *)(f + c * fStride), t + c * tStride);
 }
 
-static Fourier::Cache<Kiss, 16> cache;
-Transforms &transforms = cache;
+static Fourier::Cache<Kiss, 16> kiss;
+
+#if BUNGEE_FOURIER_RADIX4
+static Fourier::Cache<Radix4<Isa::generic>, 16> radix4;
+#endif
+#if BUNGEE_FOURIER_RADIX4_AVX2
+static Fourier::Cache<Radix4<Isa::avx2>, 16> radix4Avx2;
+#endif
+#if BUNGEE_FOURIER_RADIX4_AVX512
+static Fourier::Cache<Radix4<Isa::avx512>, 16> radix4Avx512;
+#endif
+
+// Chooses the fastest engine that was compiled in and that the CPU supports, falling back to kissfft.
+static Transforms &select()
+{
+#if BUNGEE_FOURIER_RADIX4_AVX2 || BUNGEE_FOURIER_RADIX4_AVX512
+	__builtin_cpu_init();
+#endif
+#if BUNGEE_FOURIER_RADIX4_AVX512
+	if (__builtin_cpu_supports("avx512f"))
+		return radix4Avx512;
+#endif
+#if BUNGEE_FOURIER_RADIX4_AVX2
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return radix4Avx2;
+#endif
+#if BUNGEE_FOURIER_RADIX4
+	return radix4;
+#else
+	return kiss;
+#endif
+}
+
+Transforms &transforms()
+{
+	static Transforms &selected = select();
+	return selected;
+}
 
 } // namespace Bungee::Fourier
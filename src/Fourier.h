@@ -3,11 +3,13 @@
 
 #pragma once
 
+#include "Arena.h"
 #include "Assert.h"
 
 #include <Eigen/Dense>
 
 #include <algorithm>
+#include <atomic>
 #include <complex>
 #include <limits>
 #include <memory>
@@ -45,56 +47,82 @@ inline float uninitialisedValue<float>()
 	return std::numeric_limits<float>::signaling_NaN();
 }
 
-template <bool frequencyDomain, class T>
-inline void resize(int log2TransformLength, int channelCount, T &array, int extra = 0)
+// Number of rows of an array large enough for a transform's time- or frequency-domain data.
+template <bool frequencyDomain, class Array>
+inline Eigen::Index rows(int log2TransformLength, int extra = 0)
 {
-	typedef typename T::Scalar Scalar;
+	typedef typename Array::Scalar Scalar;
 	if constexpr (frequencyDomain)
 	{
 		auto pad = std::max<int>(1, EIGEN_DEFAULT_ALIGN_BYTES / std::min<int>(4, sizeof(Scalar)));
-		array.resize(binCount(log2TransformLength) - 1 + pad + extra, channelCount);
+		return binCount(log2TransformLength) - 1 + pad + extra;
 	}
 	else
 	{
-		array.resize(transformLength(log2TransformLength) + extra, channelCount);
+		return transformLength(log2TransformLength) + extra;
 	}
+}
+
+template <bool frequencyDomain, class Array>
+inline Eigen::Map<Array> map(typename Array::Scalar *data, int log2TransformLength, int channelCount, int extra = 0)
+{
+	return Eigen::Map<Array>(data, rows<frequencyDomain, Array>(log2TransformLength, extra), channelCount);
+}
+
+// Carves from the arena an array large enough for a transform's time- or frequency-domain data.
+template <bool frequencyDomain, class Array>
+inline Eigen::Map<Array> allocate(Arena &arena, int log2TransformLength, int channelCount, int extra = 0)
+{
+	typedef typename Array::Scalar Scalar;
+	auto array = arena.array<Array>(rows<frequencyDomain, Array>(log2TransformLength, extra), channelCount);
 
 	if constexpr (Assert::level)
 		array.setConstant(uninitialisedValue<Scalar>());
+
+	return array;
 }
 
+// Transforms every column (channel) of a block in one call. The input of either transform, t for forward
+// or f for inverse, may be used as workspace so its content is undefined after the call.
 struct Transforms
 {
 	virtual ~Transforms() {}
 	virtual void prepareForward(int log2Length) = 0;
 	virtual void prepareInverse(int log2Length) = 0;
-	virtual void forward(int log2TransformLength, const Eigen::Ref<const Eigen::ArrayXXf> &t, Eigen::Ref<Eigen::ArrayXXcf> f) const = 0;
-	virtual void inverse(int log2TransformLength, Eigen::Ref<Eigen::ArrayXXf> t, const Eigen::Ref<const Eigen::ArrayXXcf> &f) const = 0;
+	virtual void forward(int log2TransformLength, Eigen::Ref<Eigen::ArrayXXf> t, Eigen::Ref<Eigen::ArrayXXcf> f) const = 0;
+	virtual void inverse(int log2TransformLength, Eigen::Ref<Eigen::ArrayXXf> t, Eigen::Ref<Eigen::ArrayXXcf> f) const = 0;
 };
 
-extern Transforms &transforms;
+// Returns the engine selected for this CPU, safe to call during static initialisation.
+Transforms &transforms();
 
 // General case when an FFT implementation has different states for forward and reverse transforms of same size.
+// Kernels, once published, are never replaced so may be read without locking.
 template <class F, class I>
 struct KernelPair
 {
-	std::shared_ptr<F> f;
-	std::shared_ptr<I> i;
+	std::atomic<F *> f{};
+	std::atomic<I *> i{};
+	~KernelPair()
+	{
+		delete f.load();
+		delete i.load();
+	}
 	inline F *forward() const
 	{
-		return f.get();
+		return f.load(std::memory_order_acquire);
 	}
 	inline I *inverse() const
 	{
-		return i.get();
+		return i.load(std::memory_order_acquire);
 	}
 	void forward(F *x)
 	{
-		f.reset(x);
+		f.store(x, std::memory_order_release);
 	}
 	void inverse(I *x)
 	{
-		i.reset(x);
+		i.store(x, std::memory_order_release);
 	}
 };
 
@@ -102,25 +130,31 @@ struct KernelPair
 template <class T>
 struct KernelPair<T, T>
 {
-	std::shared_ptr<T> t;
+	std::atomic<T *> t{};
+	~KernelPair()
+	{
+		delete t.load();
+	}
 	inline T *forward() const
 	{
-		return t.get();
+		return t.load(std::memory_order_acquire);
 	}
 	inline T *inverse() const
 	{
-		return t.get();
+		return t.load(std::memory_order_acquire);
 	}
 	void forward(T *x)
 	{
-		t.reset(x);
+		t.store(x, std::memory_order_release);
 	}
 	void inverse(T *x)
 	{
-		t.reset(x);
+		t.store(x, std::memory_order_release);
 	}
 };
 
+// K::Forward and K::Inverse kernels receive all channels of a block at once, each channel's data
+// being found at a fixed stride (in elements) from the previous channel's.
 template <class K, int log2MaxSize>
 struct Cache :
 	Transforms
@@ -131,8 +165,13 @@ struct Cache :
 
 	Table table;
 
+	// Once a size is prepared, preparing it again is a wait-free atomic read that neither locks nor allocates.
 	void prepareForward(int log2Length) override
 	{
+		if (table[log2Length].forward())
+			return;
+
+		Assert::RealTime::check("mutex lock within a RealTime section");
 		std::scoped_lock lock(preparationMutex);
 		if (!table[log2Length].forward())
 			table[log2Length].forward(new K::Forward(log2Length));
@@ -140,33 +179,33 @@ struct Cache :
 
 	void prepareInverse(int log2Length) override
 	{
+		if (table[log2Length].inverse())
+			return;
+
+		Assert::RealTime::check("mutex lock within a RealTime section");
 		std::scoped_lock lock(preparationMutex);
 		if (!table[log2Length].inverse())
 			table[log2Length].inverse(new K::Inverse(log2Length));
 	}
 
-	void forward(int log2TransformLength, const Eigen::Ref<const Eigen::ArrayXXf> &t, Eigen::Ref<Eigen::ArrayXXcf> f) const override
+	void forward(int log2TransformLength, Eigen::Ref<Eigen::ArrayXXf> t, Eigen::Ref<Eigen::ArrayXXcf> f) const override
 	{
-		BUNGEE_ASSERT1(t.cols() == t.cols());
-		BUNGEE_ASSERT1(t.cols() == 1 || !t.IsRowMajor);
-		BUNGEE_ASSERT1(f.cols() == 1 || !f.IsRowMajor);
+		BUNGEE_ASSERT1(t.cols() == f.cols());
+		BUNGEE_ASSERT1(t.rows() >= transformLength(log2TransformLength));
+		BUNGEE_ASSERT1(f.rows() >= binCount(log2TransformLength));
 
-		const auto transformLength = 1 << log2TransformLength;
 		const auto &kernel = *table[log2TransformLength].forward();
-		for (int c = 0; c < f.cols(); ++c)
-			kernel.forward(log2TransformLength, (float *)t.col(c).topRows(transformLength).data(), f.col(c).topRows(transformLength / 2 + 1).data());
+		kernel.forward(log2TransformLength, f.cols(), t.data(), t.outerStride(), f.data(), f.outerStride());
 	}
 
-	void inverse(int log2TransformLength, Eigen::Ref<Eigen::ArrayXXf> t, const Eigen::Ref<const Eigen::ArrayXXcf> &f) const override
+	void inverse(int log2TransformLength, Eigen::Ref<Eigen::ArrayXXf> t, Eigen::Ref<Eigen::ArrayXXcf> f) const override
 	{
-		BUNGEE_ASSERT1(t.cols() == t.cols());
-		BUNGEE_ASSERT1(t.cols() == 1 || !t.IsRowMajor);
-		BUNGEE_ASSERT1(f.cols() == 1 || !f.IsRowMajor);
+		BUNGEE_ASSERT1(t.cols() == f.cols());
+		BUNGEE_ASSERT1(t.rows() >= transformLength(log2TransformLength));
+		BUNGEE_ASSERT1(f.rows() >= binCount(log2TransformLength));
 
-		const auto transformLength = 1 << log2TransformLength;
 		const auto &kernel = *table[log2TransformLength].inverse();
-		for (int c = 0; c < f.cols(); ++c)
-			kernel.inverse(log2TransformLength, t.col(c).topRows(transformLength).data(), (std::complex<float> *)f.col(c).topRows(transformLength / 2 + 1).data());
+		kernel.inverse(log2TransformLength, f.cols(), t.data(), t.outerStride(), f.data(), f.outerStride());
 	}
 };
 
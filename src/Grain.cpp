@@ -10,19 +10,18 @@
 
 namespace Bungee {
 
-Grain::Grain(int log2SynthesisHop, int channelCount) :
+Grain::Grain(int log2SynthesisHop, int channelCount, Arena &arena, std::complex<float> *transformedData) :
 	log2TransformLength(log2SynthesisHop + 3),
-	segment(log2SynthesisHop, channelCount),
-	inputResampled(1 << log2TransformLength, channelCount)
+	transformed(transformedData ? Fourier::map<true, Eigen::ArrayXXcf>(transformedData, log2TransformLength, channelCount) : Fourier::allocate<true, Eigen::ArrayXXcf>(arena, log2TransformLength, channelCount)),
+	phase(Fourier::allocate<true, Eigen::ArrayX<Phase::Type>>(arena, log2TransformLength, 1)),
+	energy(Fourier::allocate<true, Eigen::ArrayXf>(arena, log2TransformLength, 1)),
+	rotation(Fourier::allocate<true, Eigen::ArrayX<Phase::Type>>(arena, log2TransformLength, 1)),
+	delta(Fourier::allocate<true, Eigen::ArrayX<Phase::Type>>(arena, log2TransformLength, 1)),
+	partials(arena.allocate<Partials::Partial>(Fourier::binCount(log2TransformLength)), Fourier::binCount(log2TransformLength)),
+	segment(log2SynthesisHop, channelCount, arena)
 {
 	request.position = request.speed = std::numeric_limits<float>::quiet_NaN();
 	request.pitch = 1.;
-	Fourier::resize<true>(log2TransformLength, channelCount, transformed);
-	Fourier::resize<true>(log2TransformLength, 1, phase);
-	Fourier::resize<true>(log2TransformLength, 1, energy);
-	Fourier::resize<true>(log2TransformLength, 1, rotation);
-	Fourier::resize<true>(log2TransformLength, 1, delta);
-	partials.reserve(1 << log2TransformLength);
 }
 
 InputChunk Grain::specify(const Request &r, Grain &previous, SampleRates sampleRates, int log2SynthesisHop)
@@ -32,7 +31,7 @@ InputChunk Grain::specify(const Request &r, Grain &previous, SampleRates sampleR
 
 	const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT);
 
-	const auto unitHop = (1 << log2SynthesisHop) * resampleOperations.setup(sampleRates, request.resampleMode, request.pitch);
+	const auto unitHop = (1 << log2SynthesisHop) * resampleOperations.setup(sampleRates, request.resampleMode, request.pitch, request.interpolationMode);
 
 	requestHop = request.position - previous.request.position;
 	if (std::isnan(requestHop) || request.reset)
@@ -57,15 +56,22 @@ InputChunk Grain::specify(const Request &r, Grain &previous, SampleRates sampleR
 
 	{
 		passthrough = std::abs(analysis.speed) == 1. ? int(analysis.speed) : 0;
+		realign = 0;
 		if (continuous && passthrough != previous.passthrough)
-			passthrough = 0;
+		{
+			if (passthrough)
+				realign = (analysis.speed == previous.analysis.speed ? previous.realign : 0) + 1;
+			if (realign > realignGrainCount)
+				realign = 0;
+			else
+				passthrough = 0;
+		}
 	}
 
 	log2TransformLength = log2SynthesisHop + 3;
-	inputResampled.frameCount = 1 << log2TransformLength;
 
 	{
-		auto halfInputFrameCount = inputResampled.frameCount / 2;
+		auto halfInputFrameCount = 1 << (log2TransformLength - 1);
 		if (resampleOperations.input.ratio != 1.f)
 			halfInputFrameCount = int(std::round(halfInputFrameCount / resampleOperations.input.ratio)) + 1;
 		inputChunk.begin = int(std::round(request.position)) - halfInputFrameCount;
@@ -75,14 +81,22 @@ InputChunk Grain::specify(const Request &r, Grain &previous, SampleRates sampleR
 	}
 }
 
-Eigen::Ref<Eigen::ArrayXXf> Grain::resampleInput(Eigen::Ref<Eigen::ArrayXXf> input, int log2WindowLength)
+float Grain::inputResampleOffset(int log2WindowLength) const
+{
+	float offset = float(inputChunk.begin - request.position);
+	offset *= resampleOperations.input.ratio;
+	offset += 1 << (log2WindowLength - 1);
+	offset -= analysis.positionError;
+	return offset;
+}
+
+Resample::Ref Grain::resampleInput(Resample::Ref input, int log2WindowLength, Resample::Padded &inputResampled)
 {
 	if (resampleOperations.input.function)
 	{
-		float offset = float(inputChunk.begin - request.position);
-		offset *= resampleOperations.input.ratio;
-		offset += 1 << (log2WindowLength - 1);
-		offset -= analysis.positionError;
+		inputResampled.frameCount = 1 << log2TransformLength;
+
+		float offset = inputResampleOffset(log2WindowLength);
 
 		resampleOperations.input.function(inputResampled, offset, input, resampleOperations.input.ratio, resampleOperations.input.ratio, false);
 
@@ -26,6 +26,9 @@ namespace Bungee {
 
 struct Grain
 {
+	// Grains over which rotation is drawn to zero before continuous input resumes passthrough
+	static constexpr int realignGrainCount = 8;
+
 	struct Analysis
 	{
 		double positionError;
@@ -40,6 +43,8 @@ struct Grain
 	double requestHop{};
 	bool continuous{};
 	int passthrough{};
+	int realign{}; // counts continuous grains eligible for passthrough while their rotation is drawn to zero
+	bool bypass{}; // forward passthrough grain whose output is its windowed input, computed without transforms
 	int validBinCount{};
 
 	Resample::Operations resampleOperations{};
@@ -47,17 +52,16 @@ struct Grain
 	InputChunk inputChunk{};
 	Analysis analysis{};
 
-	Eigen::ArrayXXcf transformed;
-	Eigen::ArrayX<Phase::Type> phase;
-	Eigen::ArrayXf energy;
-	Eigen::ArrayX<Phase::Type> rotation;
-	Eigen::ArrayX<Phase::Type> delta;
-	std::vector<Partials::Partial> partials;
-	Resample::Padded inputResampled;
+	Eigen::Map<Eigen::ArrayXXcf> transformed;
+	Eigen::Map<Eigen::ArrayX<Phase::Type>> phase;
+	Eigen::Map<Eigen::ArrayXf> energy;
+	Eigen::Map<Eigen::ArrayX<Phase::Type>> rotation;
+	Eigen::Map<Eigen::ArrayX<Phase::Type>> delta;
+	Partials::List partials;
 
 	Output::Segment segment;
 
-	Grain(int log2SynthesisHop, int channelCount);
+	Grain(int log2SynthesisHop, int channelCount, Arena &arena, std::complex<float> *transformedData = nullptr);
 
 	InputChunk specify(const Request &request, Grain &previous, SampleRates sampleRates, int log2SynthesisHop);
 
@@ -73,14 +77,25 @@ struct Grain
 
 	void applyEnvelope();
 
-	auto inputChunkMap(const float *data, std::ptrdiff_t stride)
+	auto inputChunkMap(const float *data, std::ptrdiff_t channelStride, std::ptrdiff_t frameStride)
 	{
-		typedef Eigen::OuterStride<Eigen::Dynamic> Stride;
+		typedef Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> Stride;
 		typedef Eigen::Map<Eigen::ArrayXXf, 0, Stride> Map;
-		return Map((float *)data, inputChunk.end - inputChunk.begin, transformed.cols(), Stride(stride));
+		return Map((float *)data, inputChunk.end - inputChunk.begin, transformed.cols(), Stride(channelStride, frameStride));
 	}
 
-	Eigen::Ref<Eigen::ArrayXXf> resampleInput(Eigen::Ref<Eigen::ArrayXXf> ref, int log2WindowLength);
+	// Number of bins, from DC upwards, that survive output resampling and so are analysed
+	int requiredBinCount() const
+	{
+		const auto n = Fourier::binCount(log2TransformLength) - 1;
+		return std::min<int>(std::ceil(n / resampleOperations.output.ratio), n) + 1;
+	}
+
+	// Position, within the input chunk, at which input resampling begins
+	float inputResampleOffset(int log2WindowLength) const;
+
+	// Returns the input unchanged or, if input resampling is active, resampled into inputResampled
+	Resample::Ref resampleInput(Resample::Ref ref, int log2WindowLength, Resample::Padded &inputResampled);
 };
 
 } // namespace Bungee
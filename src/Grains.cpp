@@ -5,8 +5,26 @@
 
 #include "log2.h"
 
+#include <algorithm>
+#include <new>
+
 namespace Bungee {
 
+Grains::Grains(int log2SynthesisHop, int channelCount, Arena &arena, std::complex<float> *transformedData, bool shareTransformed)
+{
+	if (!transformedData && shareTransformed)
+		transformedData = Fourier::allocate<true, Eigen::ArrayXXcf>(arena, log2SynthesisHop + 3, channelCount).data();
+
+	for (int i = 0; i < (int)vector.size(); ++i)
+		vector[i] = new (arena.allocate<Grain>(1)) Grain(log2SynthesisHop, channelCount, arena, transformedData);
+}
+
+Grains::~Grains()
+{
+	for (auto grain : vector)
+		grain->~Grain();
+}
+
 bool Grains::flushed() const
 {
 	for (auto &grain : vector)
@@ -17,10 +35,14 @@ bool Grains::flushed() const
 
 void Grains::rotate()
 {
-	std::unique_ptr<Grain> grain = std::move(vector.front());
-	for (int i = 0; i < vector.size() - 1; ++i)
-		vector[i] = std::move(vector[i + 1]);
-	vector.back() = std::move(grain);
+	std::rotate(vector.begin(), vector.begin() + 1, vector.end());
+}
+
+Grain *Grains::rotate(Grain *incoming)
+{
+	std::swap(incoming, vector[0]);
+	rotate();
+	return incoming;
 }
 
 } // namespace Bungee
@@ -5,22 +5,27 @@
 
 #include "Grain.h"
 
-#include <memory>
-#include <vector>
+#include <array>
 
 namespace Bungee {
 
 struct Grains
 {
-	std::vector<std::unique_ptr<Grain>> vector;
+	std::array<Grain *, 4> vector;
 
-	Grains(size_t n) :
-		vector(n)
-	{
-	}
+	// Only the newest grain's spectrum is live at any time, so all grains' transformed arrays share one buffer
+	// unless shareTransformed is false, as is needed when one grain is analysed while another is synthesised
+	Grains(int log2SynthesisHop, int channelCount, Arena &arena, std::complex<float> *transformedData = nullptr, bool shareTransformed = true);
+	~Grains();
+
+	Grains(const Grains &) = delete;
+	Grains &operator=(const Grains &) = delete;
 
 	void rotate();
 
+	// Rotates with incoming taking the place of the oldest grain, which is returned
+	Grain *rotate(Grain *incoming);
+
 	bool flushed() const;
 
 	inline Grain &operator[](size_t i)
@@ -14,19 +14,36 @@ static constexpr float pi = std::numbers::pi_v<float>;
 static constexpr float gain = (3 * pi) / (3 * pi + 8);
 } // namespace
 
-Input::Input(int log2SynthesisHop, int channelCount) :
-	analysisWindowBasic(Window::fromFrequencyDomainCoefficients(log2SynthesisHop + 3, gain / (8 << log2SynthesisHop), {1.f, 0.5f})),
-	windowedInput{(8 << log2SynthesisHop), channelCount}
+Input::Input(int log2SynthesisHop, int channelCount, Arena &arena, float *windowedInputData) :
+	analysisWindowBasic(arena.array<Eigen::ArrayXf>(8 << log2SynthesisHop, 1)),
+	windowedInput(windowedInputData ? Eigen::Map<Eigen::ArrayXXf>(windowedInputData, 8 << log2SynthesisHop, channelCount) : arena.array<Eigen::ArrayXXf>(8 << log2SynthesisHop, channelCount)),
+	resampled(8 << log2SynthesisHop, channelCount, arena)
 {
+	Window::fromFrequencyDomainCoefficients(analysisWindowBasic, gain / (8 << log2SynthesisHop), {1.f, 0.5f});
 	windowedInput.setZero();
-	Fourier::transforms.prepareForward(log2SynthesisHop + 3);
+	prepareTransforms(log2SynthesisHop);
 }
 
-int Input::applyAnalysisWindow(const Eigen::Ref<const Eigen::ArrayXXf> &input)
+void Input::prepareTransforms(int log2SynthesisHop)
+{
+	Fourier::transforms().prepareForward(log2SynthesisHop + 3);
+}
+
+int Input::applyAnalysisWindow(const Resample::Ref &input)
 {
 	const auto half = analysisWindowBasic.rows() / 2;
-	Window::Apply::special<false>(analysisWindowBasic.head(half), input.bottomRows(input.rows() / 2).topRows(half), windowedInput.topRows(half));
-	Window::Apply::special<false>(analysisWindowBasic.tail(half), input.topRows(input.rows() / 2).bottomRows(half), windowedInput.bottomRows(half));
+	if (input.innerStride() == 1)
+	{
+		typedef Eigen::Map<const Eigen::ArrayXXf, 0, Eigen::OuterStride<>> Map;
+		const Map planar(input.data(), input.rows(), input.cols(), Eigen::OuterStride<>(input.outerStride()));
+		Window::Apply::special<false>(analysisWindowBasic.head(half), planar.bottomRows(input.rows() / 2).topRows(half), windowedInput.topRows(half));
+		Window::Apply::special<false>(analysisWindowBasic.tail(half), planar.topRows(input.rows() / 2).bottomRows(half), windowedInput.bottomRows(half));
+	}
+	else
+	{
+		windowedInput.topRows(half) = input.bottomRows(input.rows() / 2).topRows(half).colwise() * analysisWindowBasic.head(half);
+		windowedInput.bottomRows(half) = input.topRows(input.rows() / 2).bottomRows(half).colwise() * analysisWindowBasic.tail(half);
+	}
 	return Bungee::log2(windowedInput.rows());
 }
 
@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include "Arena.h"
 #include "Assert.h"
+#include "Resample.h"
 
 #include <Eigen/Dense>
 
@@ -11,12 +13,16 @@ namespace Bungee {
 
 struct Input
 {
-	Eigen::ArrayXf analysisWindowBasic;
-	Eigen::ArrayXXf windowedInput;
+	Eigen::Map<Eigen::ArrayXf> analysisWindowBasic;
+	Eigen::Map<Eigen::ArrayXXf> windowedInput;
+	Resample::Padded resampled; // scratch for the grain being analysed when input resampling is active
 
-	Input(int log2SynthesisHop, int channelCount);
+	Input(int log2SynthesisHop, int channelCount, Arena &arena, float *windowedInputData = nullptr);
 
-	int applyAnalysisWindow(const Eigen::Ref<const Eigen::ArrayXXf> &input);
+	static void prepareTransforms(int log2SynthesisHop);
+
+	// Input may have any frame stride: interleaved input is deinterleaved as it is windowed
+	int applyAnalysisWindow(const Resample::Ref &input);
 };
 
 } // namespace Bungee
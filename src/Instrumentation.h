@@ -0,0 +1,147 @@
+// Copyright (C) 2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#pragma once
+
+#include "bungee/Bungee.h"
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#else
+#	include <chrono>
+#endif
+
+#ifndef BUNGEE_INSTRUMENTATION
+#	define BUNGEE_INSTRUMENTATION 0 // Statistics read as zero and instrumentation compiles to nothing
+// #define BUNGEE_INSTRUMENTATION 1 // Statistics are gathered
+#endif
+
+namespace Bungee::Instrumentation {
+
+static constexpr bool enabled = BUNGEE_INSTRUMENTATION;
+
+static inline uint64_t ticks()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t t;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+	return t;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+#if BUNGEE_INSTRUMENTATION
+
+// Read, without locks, by statistics(). Every counter has a single writer. The caller's thread, which calls the grain
+// functions, writes all of them except workerTicks. With PipelineMode::twoThread, the worker thread writes only
+// workerTicks, for the forward transform and analysis stages. The caller's thread still writes ticks[analysis], for windowing.
+// Only the caller's ticks count towards grainTicks, so the histogram measures the caller's thread alone.
+struct Counters
+{
+	std::atomic<uint64_t> ticks[Statistics::stageCount]{};
+	std::atomic<uint64_t> workerTicks[Statistics::stageCount]{};
+	std::atomic<uint64_t> grainCount{};
+	std::atomic<uint64_t> discontinuousGrainCount{};
+	std::atomic<uint64_t> passthroughGrainCount{};
+	std::atomic<uint64_t> resampledGrainCount{};
+	std::atomic<uint64_t> histogram[Statistics::histogramSize]{};
+	std::atomic<uint64_t> maxGrainTicks{};
+	std::atomic<uint64_t> grainTicks{};
+
+	// With a single writer, a relaxed load and store is sufficient and avoids a locked read-modify-write
+	static void add(std::atomic<uint64_t> &counter, uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	void countGrain(bool valid, bool continuous, bool passthrough, bool resampled)
+	{
+		if (valid)
+		{
+			add(grainCount, 1);
+			add(discontinuousGrainCount, !continuous);
+			add(passthroughGrainCount, passthrough);
+			add(resampledGrainCount, resampled);
+		}
+	}
+
+	void endGrain()
+	{
+		if (const auto ticks = grainTicks.load(std::memory_order_relaxed))
+		{
+			grainTicks.store(0, std::memory_order_relaxed);
+			add(histogram[std::min<int>(std::bit_width(ticks), Statistics::histogramSize - 1)], 1);
+			if (ticks > maxGrainTicks.load(std::memory_order_relaxed))
+				maxGrainTicks.store(ticks, std::memory_order_relaxed);
+		}
+	}
+
+	void snapshot(Statistics &statistics) const
+	{
+		for (int i = 0; i < Statistics::stageCount; ++i)
+			statistics.ticks[i] = ticks[i].load(std::memory_order_relaxed) + workerTicks[i].load(std::memory_order_relaxed);
+		statistics.grainCount = grainCount.load(std::memory_order_relaxed);
+		statistics.discontinuousGrainCount = discontinuousGrainCount.load(std::memory_order_relaxed);
+		statistics.passthroughGrainCount = passthroughGrainCount.load(std::memory_order_relaxed);
+		statistics.resampledGrainCount = resampledGrainCount.load(std::memory_order_relaxed);
+		for (int i = 0; i < Statistics::histogramSize; ++i)
+			statistics.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+		statistics.maxGrainTicks = maxGrainTicks.load(std::memory_order_relaxed);
+	}
+};
+
+// Adds the ticks elapsed during its lifetime to a stage's total and, unless on the worker thread, to the current grain's total
+struct Scope
+{
+	Counters &counters;
+	const Statistics::Stage stage;
+	const bool worker;
+	const uint64_t start;
+
+	Scope(Counters &counters, Statistics::Stage stage, bool worker = false) :
+		counters(counters),
+		stage(stage),
+		worker(worker),
+		start(Instrumentation::ticks())
+	{
+	}
+
+	~Scope()
+	{
+		const auto elapsed = Instrumentation::ticks() - start;
+		if (worker)
+			Counters::add(counters.workerTicks[stage], elapsed);
+		else
+		{
+			Counters::add(counters.ticks[stage], elapsed);
+			Counters::add(counters.grainTicks, elapsed);
+		}
+	}
+};
+
+#else
+
+struct Counters
+{
+	void countGrain(bool, bool, bool, bool) {}
+	void endGrain() {}
+	void snapshot(Statistics &) const {}
+};
+
+struct Scope
+{
+	Scope(Counters &, Statistics::Stage, bool = false) {}
+};
+
+#endif
+
+} // namespace Bungee::Instrumentation
@@ -7,15 +7,23 @@
 
 namespace Bungee {
 
-Output::Output(int log2SynthesisHop, int channelCount, int maxOutputChunkSize, float windowGain, std::initializer_list<float> windowCoefficients) :
-	synthesisWindow{Window::fromFrequencyDomainCoefficients(log2SynthesisHop + 2, windowGain, windowCoefficients)},
-	inverseTransformed(8 << log2SynthesisHop, channelCount),
-	bufferResampled(maxOutputChunkSize, channelCount)
+Output::Output(int log2SynthesisHop, int channelCount, int maxOutputChunkSize, float windowGain, std::initializer_list<float> windowCoefficients, Arena &arena, float *inverseTransformedData) :
+	synthesisWindow(arena.array<Eigen::ArrayXf>(4 << log2SynthesisHop, 1)),
+	bypassWindow(arena.array<Eigen::ArrayXf>(4 << log2SynthesisHop, 1)),
+	inverseTransformed(inverseTransformedData ? Eigen::Map<Eigen::ArrayXXf>(inverseTransformedData, 8 << log2SynthesisHop, channelCount) : arena.array<Eigen::ArrayXXf>(8 << log2SynthesisHop, channelCount)),
+	bufferResampled(arena.array<Eigen::ArrayXXf>(maxOutputChunkSize, channelCount))
 {
-	Fourier::transforms.prepareInverse(log2SynthesisHop + 3);
+	Window::fromFrequencyDomainCoefficients(synthesisWindow, windowGain, windowCoefficients);
+	bypassWindow = synthesisWindow * float(8 << log2SynthesisHop);
+	prepareTransforms(log2SynthesisHop);
 }
 
-void Output::applySynthesisWindow(int log2SynthesisHop, Grains &grains, const Eigen::Ref<const Eigen::ArrayXf> &window)
+void Output::prepareTransforms(int log2SynthesisHop)
+{
+	Fourier::transforms().prepareInverse(log2SynthesisHop + 3);
+}
+
+void Output::applySynthesisWindow(int log2SynthesisHop, Grains &grains, const Eigen::Ref<const Eigen::ArrayXf> &window, const Eigen::Ref<const Eigen::ArrayXXf> &source)
 {
 	const auto quadrantSize = window.rows() / 4;
 	const auto hopsPerTransform = 1 << (grains[0].log2TransformLength - log2SynthesisHop);
@@ -32,7 +40,7 @@ void Output::applySynthesisWindow(int log2SynthesisHop, Grains &grains, const Ei
 			auto windowSegment = window.segment(quadrantSize * (i ^ 2), quadrantSize);
 
 			auto j = (i + hopsPerTransform - 2) % hopsPerTransform;
-			auto inputSegment = inverseTransformed.middleRows(quadrantSize * j, quadrantSize);
+			auto inputSegment = source.middleRows(quadrantSize * j, quadrantSize);
 
 			const bool add = quandrant.frameCount != 0;
 			dispatchApply[add](windowSegment, inputSegment, quandrant.unpadded().topRows(quadrantSize));
@@ -52,8 +60,8 @@ void Output::applySynthesisWindow(int log2SynthesisHop, Grains &grains, const Ei
 		grains[0].resampleOperations.output.function;
 }
 
-Output::Segment::Segment(int log2FrameCount, int channelCount) :
-	bufferLapped(1 << log2FrameCount, channelCount)
+Output::Segment::Segment(int log2FrameCount, int channelCount, Arena &arena) :
+	bufferLapped(1 << log2FrameCount, channelCount, arena)
 {
 }
 
@@ -78,7 +86,47 @@ void Output::Segment::lapPadding(Segment &current, Segment &next)
 	}
 }
 
-inline OutputChunk Output::Segment::outputChunk(Eigen::Ref<Eigen::ArrayXXf> ref, bool allZeros)
+namespace {
+
+template <bool accumulate, bool contiguous>
+void mixChannel(const float *source, float *destination, std::ptrdiff_t step, int frameCount, float gain, float gradient)
+{
+	if constexpr (contiguous)
+		step = 1;
+	for (int i = 0; i < frameCount; ++i)
+	{
+		const float x = source[i] * (gain + gradient * i);
+		if constexpr (accumulate)
+			destination[i * step] += x;
+		else
+			destination[i * step] = x;
+	}
+}
+
+} // namespace
+
+void Output::mix(OutputChunk &outputChunk, const OutputDestination &destination) const
+{
+	BUNGEE_ASSERT1(outputChunk.frameStride == 1);
+
+	const auto gain = destination.gain[OutputDestination::begin];
+	const auto gradient = outputChunk.frameCount ? (destination.gain[OutputDestination::end] - gain) / outputChunk.frameCount : 0.f;
+
+	auto function = &mixChannel<false, false>;
+	if (destination.accumulate)
+		function = destination.frameStride == 1 ? &mixChannel<true, true> : &mixChannel<true, false>;
+	else if (destination.frameStride == 1)
+		function = &mixChannel<false, true>;
+
+	for (int c = 0; c < bufferResampled.cols(); ++c)
+		function(outputChunk.data + c * outputChunk.channelStride, destination.data + c * destination.channelStride, destination.frameStride, outputChunk.frameCount, gain, gradient);
+
+	outputChunk.data = destination.data;
+	outputChunk.channelStride = destination.channelStride;
+	outputChunk.frameStride = destination.frameStride;
+}
+
+inline OutputChunk Output::Segment::outputChunk(Resample::Ref ref, bool allZeros)
 {
 	if (allZeros)
 		ref.setZero();
@@ -86,11 +134,12 @@ inline OutputChunk Output::Segment::outputChunk(Eigen::Ref<Eigen::ArrayXXf> ref,
 	OutputChunk outputChunk{};
 	outputChunk.data = ref.data();
 	outputChunk.frameCount = ref.rows();
-	outputChunk.channelStride = ref.stride();
+	outputChunk.channelStride = ref.outerStride();
+	outputChunk.frameStride = ref.innerStride();
 	return outputChunk;
 }
 
-OutputChunk Output::Segment::resample(float &resampleOffset, Resample::Operation resampleOperationBegin, Resample::Operation resampleOperationEnd, Eigen::Ref<Eigen::ArrayXXf> bufferResampled)
+OutputChunk Output::Segment::resample(float &resampleOffset, Resample::Operation resampleOperationBegin, Resample::Operation resampleOperationEnd, Resample::Ref bufferResampled)
 {
 	if (!resampleOperationBegin.function)
 		resampleOperationBegin.ratio = 1.f;
@@ -114,6 +163,15 @@ OutputChunk Output::Segment::resample(float &resampleOffset, Resample::Operation
 
 		return outputChunk(bufferResampled.topRows(frameCount), bufferLapped.allZeros);
 	}
+	else if (bufferResampled.innerStride() != 1)
+	{
+		// interleave as the completed segment is copied out
+		BUNGEE_ASSERT1(bufferLapped.frameCount <= bufferResampled.rows());
+		auto interleaved = bufferResampled.topRows(bufferLapped.frameCount);
+		if (!bufferLapped.allZeros)
+			interleaved = bufferLapped.unpadded().topRows(bufferLapped.frameCount);
+		return outputChunk(interleaved, bufferLapped.allZeros);
+	}
 	else
 	{
 		return outputChunk(bufferLapped.unpadded().topRows(bufferLapped.frameCount), bufferLapped.allZeros);
@@ -19,25 +19,35 @@ struct Grains;
 
 struct Output
 {
-	Eigen::ArrayXf synthesisWindow;
-	Eigen::ArrayXXf inverseTransformed;
-	Eigen::ArrayXXf bufferResampled;
+	Eigen::Map<Eigen::ArrayXf> synthesisWindow;
+	Eigen::Map<Eigen::ArrayXf> bypassWindow; // synthesisWindow scaled by the gain of a forward and inverse transform
+	Eigen::Map<Eigen::ArrayXXf> inverseTransformed;
+	Eigen::Map<Eigen::ArrayXXf> bufferResampled;
 	float resampleOffset = 0.f;
 	Window::DispatchApply dispatchApply;
 
-	Output(int log2SynthesisHop, int channelCount, int maxOutputChunkSize, float windowGain, std::initializer_list<float> windowCoefficients);
+	Output(int log2SynthesisHop, int channelCount, int maxOutputChunkSize, float windowGain, std::initializer_list<float> windowCoefficients, Arena &arena, float *inverseTransformedData = nullptr);
 
-	void applySynthesisWindow(int log2SynthesisHop, Grains &grains, const Eigen::Ref<const Eigen::ArrayXf> &window);
+	static void prepareTransforms(int log2SynthesisHop);
+
+	void applySynthesisWindow(int log2SynthesisHop, Grains &grains, const Eigen::Ref<const Eigen::ArrayXf> &window, const Eigen::Ref<const Eigen::ArrayXXf> &source);
+
+	// Writes or adds a planar output chunk, scaled by destination's gain ramp, into destination,
+	// then updates outputChunk to refer to the destination
+	void mix(OutputChunk &outputChunk, const OutputDestination &destination) const;
 
 	struct Segment
 	{
 		Resample::Padded bufferLapped;
 		bool needsResample;
 
-		Segment(int log2FrameCount, int channelCount);
-		static inline OutputChunk outputChunk(Eigen::Ref<Eigen::ArrayXXf> ref, bool allZeros);
+		Segment(int log2FrameCount, int channelCount, Arena &arena);
+		static inline OutputChunk outputChunk(Resample::Ref ref, bool allZeros);
 		static void lapPadding(Segment &current, Segment &next);
-		OutputChunk resample(float &resampleOffset, Resample::Operation resampleOperationBegin, Resample::Operation resampleOperationEnd, Eigen::Ref<Eigen::ArrayXXf> bufferResampled);
+
+		// Output is written to bufferResampled if resampling is active or if bufferResampled is strided (interleaved),
+		// otherwise the returned chunk refers directly to bufferLapped
+		OutputChunk resample(float &resampleOffset, Resample::Operation resampleOperationBegin, Resample::Operation resampleOperationEnd, Resample::Ref bufferResampled);
 	};
 };
 
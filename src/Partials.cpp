@@ -3,39 +3,53 @@
 
 #include "Partials.h"
 
+#include <algorithm>
+#include <bit>
+
 namespace Bungee::Partials {
 
-void enumerate(std::vector<Partial> &partials, int n, Eigen::Ref<Eigen::ArrayX<float>> energy)
+// Partials are delimited by the edges of rise[m] = energy[m] < energy[m + 1]: a peak is at each falling edge and a
+// partial ends at each rising edge. For m in [0, n] rise is packed 64 bits to a word, with rise[0] and rise[n] set and
+// rise[n - 1] clear so that the first edge is a peak and the last is a rising edge at n. Bits beyond n are set.
+// Set bits of the edge mask are then extracted in turn, alternately giving a peak and an end.
+void enumerate(List &partials, int n, const Eigen::Ref<const Eigen::ArrayX<float>> energy)
 {
-	float undo[] = {-1.f, 0.f};
-	std::swap(energy[n], undo[0]);
-	std::swap(energy[n + 1], undo[1]);
-
-	partials.resize(partials.capacity());
+	BUNGEE_ASSERT1(n >= 2);
 
-	int count = 0;
-	int m = 1;
-	do
+	int k = 0;
+	uint64_t carry = 1;
+	for (int base = 0; base <= n; base += 64)
 	{
-		while ((energy[m] < energy[m + 1]))
-			m++;
-		partials[count].peak = m++;
+		uint64_t rise = 0;
+		const int last = std::min(base + 64, n - 1);
+		for (int m = std::max(base, 1); m < last; ++m)
+			rise |= uint64_t(energy[m] < energy[m + 1]) << (m - base);
+		if (base == 0)
+			rise |= 1;
+		if (unsigned(n - 1 - base) < 64)
+			rise &= ~(uint64_t(1) << (n - 1 - base));
+		if (n - base < 64)
+			rise |= ~uint64_t(0) << (n - base);
 
-		while (!(energy[m] < energy[m + 1]))
-			m++;
-		partials[count++].end = m++;
+		uint64_t edges = rise ^ (rise << 1 | carry);
+		carry = rise >> 63;
 
-	} while (m < n + 1);
+		for (; edges; edges &= edges - 1)
+		{
+			BUNGEE_ASSERT2((k >> 1) < partials.capacity);
+			auto &partial = partials.array[k >> 1];
+			(k & 1 ? partial.end : partial.peak) = int16_t(base + std::countr_zero(edges));
+			++k;
+		}
+	}
 
-	partials.resize(count);
+	BUNGEE_ASSERT1(!(k & 1));
+	partials.count = k >> 1;
 
 	BUNGEE_ASSERT1(partials.back().end == n);
-
-	std::swap(energy[n], undo[0]);
-	std::swap(energy[n + 1], undo[1]);
 }
 
-inline void suppressPartial(std::vector<Partial> &partials, int i, const Eigen::Ref<const Eigen::ArrayX<float>> energy)
+inline void suppressPartial(List &partials, int i, const Eigen::Ref<const Eigen::ArrayX<float>> energy)
 {
 	if (energy[partials[i - 1].end] > energy[partials[i].end])
 		partials[i - 1].end = partials[i].end;
@@ -43,7 +57,7 @@ inline void suppressPartial(std::vector<Partial> &partials, int i, const Eigen::
 		partials[i].end = partials[i - 1].end;
 }
 
-void suppressTransientPartials(std::vector<Partial> &partials, const Eigen::Ref<const Eigen::ArrayX<float>> energy, const Eigen::Ref<const Eigen::ArrayX<float>> previousEnergy)
+void suppressTransientPartials(List &partials, const Eigen::Ref<const Eigen::ArrayX<float>> energy, const Eigen::Ref<const Eigen::ArrayX<float>> previousEnergy)
 {
 	int strongestPartialIndex = 0;
 	for (int i = 1; i < partials.size(); ++i)
@@ -8,7 +8,6 @@
 #include <Eigen/Dense>
 
 #include <cstdint>
-#include <vector>
 
 namespace Bungee::Partials {
 
@@ -18,8 +17,44 @@ struct Partial
 	int16_t end;
 };
 
-void enumerate(std::vector<Partial> &partials, int n, Eigen::Ref<Eigen::ArrayX<float>> energy);
+// Fixed-capacity list of partials whose storage is allocated when the stretcher is constructed.
+struct List
+{
+	Partial *const array;
+	const int capacity;
+	int count = 0;
+
+	List(Partial *array, int capacity) :
+		array(array),
+		capacity(capacity)
+	{
+	}
+
+	int size() const
+	{
+		return count;
+	}
+
+	Partial &operator[](int i)
+	{
+		BUNGEE_ASSERT2(i >= 0 && i < count);
+		return array[i];
+	}
+
+	const Partial &operator[](int i) const
+	{
+		BUNGEE_ASSERT2(i >= 0 && i < count);
+		return array[i];
+	}
+
+	const Partial &back() const
+	{
+		return (*this)[count - 1];
+	}
+};
+
+void enumerate(List &partials, int n, const Eigen::Ref<const Eigen::ArrayX<float>> energy);
 
-void suppressTransientPartials(std::vector<Partial> &partials, const Eigen::Ref<const Eigen::ArrayX<float>> energy, const Eigen::Ref<const Eigen::ArrayX<float>> previousEnergy);
+void suppressTransientPartials(List &partials, const Eigen::Ref<const Eigen::ArrayX<float>> energy, const Eigen::Ref<const Eigen::ArrayX<float>> previousEnergy);
 
 } // namespace Bungee::Partials
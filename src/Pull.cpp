@@ -0,0 +1,145 @@
+// Copyright (C) 2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#include "bungee/Pull.h"
+#include "Assert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Bungee::Pull {
+
+// Output is held in a planar linear buffer that the stretcher synthesises into directly. When there is
+// no longer room for a whole grain's output at its end, the frames not yet pulled are moved to its start.
+struct OutputBuffer::Implementation
+{
+	Stretcher &stretcher;
+	Source &source;
+	Request request;
+	const int channelCount;
+	const int blockFrameCount;
+	const int maxOutputFrameCount;
+	const int capacity; // frames per channel
+	std::vector<float> buffer;
+	int begin = 0;
+	int end = 0;
+	bool analysed = false;
+	int fillGrains = 4; // chunks that may yet be discarded while the stretcher's pipeline fills
+	float chunkFrameCount; // running estimate of the frames emitted per grain
+	float credit = 0.f; // halves of grain processing that pull() may perform ahead of need
+
+	Implementation(Stretcher &stretcher, Source &source, int channelCount, int blockFrameCount, const Request &request) :
+		stretcher(stretcher),
+		source(source),
+		request(request),
+		channelCount(channelCount),
+		blockFrameCount(blockFrameCount),
+		maxOutputFrameCount(stretcher.maxOutputFrameCount()),
+		capacity(blockFrameCount + 3 * maxOutputFrameCount),
+		buffer(std::size_t(capacity) * channelCount),
+		chunkFrameCount(maxOutputFrameCount / 4.f)
+	{
+	}
+
+	int available() const
+	{
+		return end - begin;
+	}
+
+	// Performs the next half of a grain's processing: either its specification and analysis or its synthesis
+	void step()
+	{
+		if (!analysed)
+		{
+			const InputChunk inputChunk = stretcher.specifyGrain(request);
+			intptr_t channelStride = 0;
+			const float *data = source.inputAudio(inputChunk, channelStride);
+			stretcher.analyseGrain(data, channelStride);
+			analysed = true;
+			return;
+		}
+
+		if (end + maxOutputFrameCount > capacity)
+		{
+			for (int c = 0; c < channelCount; ++c)
+			{
+				auto channel = &buffer[std::size_t(c) * capacity];
+				std::move(channel + begin, channel + end, channel);
+			}
+			end -= begin;
+			begin = 0;
+		}
+
+		OutputDestination destination{&buffer[end], capacity, 1, false, {1.f, 1.f}};
+		OutputChunk outputChunk;
+		stretcher.synthesiseGrain(outputChunk, destination);
+		analysed = false;
+
+		if (fillGrains && std::isnan(outputChunk.request[OutputChunk::begin]->position))
+			--fillGrains;
+		else
+		{
+			fillGrains = 0;
+			end += outputChunk.frameCount;
+			if (outputChunk.frameCount)
+				chunkFrameCount += (outputChunk.frameCount - chunkFrameCount) * (1.f / 8);
+		}
+
+		stretcher.next(request);
+		source.nextRequest(request);
+	}
+};
+
+OutputBuffer::OutputBuffer(Stretcher &stretcher, Source &source, int channelCount, int blockFrameCount, const Request &request) :
+	state(new Implementation(stretcher, source, channelCount, blockFrameCount, request))
+{
+	BUNGEE_ASSERT1(blockFrameCount > 0);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+	delete state;
+}
+
+int OutputBuffer::blockFrameCount() const
+{
+	return state->blockFrameCount;
+}
+
+void OutputBuffer::pull(const OutputDestination &destination)
+{
+	auto &s = *state;
+	const int n = s.blockFrameCount;
+
+	// Two halves of grain processing are needed, on average, for every chunkFrameCount frames pulled
+	s.credit = std::min(s.credit + 2 * n / s.chunkFrameCount, 1.f + 2 * n / s.chunkFrameCount);
+
+	for (; s.available() < n; s.credit -= 1.f)
+		s.step();
+	s.credit = std::max(s.credit, 0.f);
+
+	const float gain = destination.gain[OutputDestination::begin];
+	const float gradient = (destination.gain[OutputDestination::end] - gain) / n;
+	for (int c = 0; c < s.channelCount; ++c)
+	{
+		const float *source = &s.buffer[std::size_t(c) * s.capacity + s.begin];
+		float *target = destination.data + c * destination.channelStride;
+		for (int i = 0; i < n; ++i)
+		{
+			const float x = source[i] * (gain + gradient * i);
+			if (destination.accumulate)
+				target[i * destination.frameStride] += x;
+			else
+				target[i * destination.frameStride] = x;
+		}
+	}
+	s.begin += n;
+
+	// Work ahead, within credit, so that the next call is unlikely to have to catch up
+	for (; s.credit >= 1.f && s.available() < n + s.maxOutputFrameCount; s.credit -= 1.f)
+		s.step();
+}
+
+} // namespace Bungee::Pull
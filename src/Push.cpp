@@ -4,22 +4,119 @@
 #include "bungee/Push.h"
 #include "Assert.h"
 
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__linux__) && !defined(__ANDROID__) || defined(__APPLE__)
+#define BUNGEE_PUSH_MIRRORED 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <atomic>
+#include <string>
+#endif
+#endif
+
 namespace Bungee::Push {
 
+namespace {
+
+#ifdef BUNGEE_PUSH_MIRRORED
+// Maps, for every channel, a ring of ringBytes twice in succession so that any run of frames
+// up to the ring's length is contiguous in virtual memory however it straddles the ring's end.
+// Returns nullptr if the operating system declines.
+void *mapMirroredRings(int channelCount, std::size_t ringBytes)
+{
+#if defined(__APPLE__)
+	static std::atomic<int> counter;
+	const auto name = "/bungee." + std::to_string(getpid()) + "." + std::to_string(counter++);
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0)
+		shm_unlink(name.c_str());
+#else
+	const int fd = memfd_create("bungee", 0);
+#endif
+	if (fd < 0)
+		return nullptr;
+
+	void *reserved = MAP_FAILED;
+	if (ftruncate(fd, off_t(channelCount * ringBytes)) == 0)
+		reserved = mmap(nullptr, 2 * channelCount * ringBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	bool ok = reserved != MAP_FAILED;
+	for (int i = 0; ok && i < 2 * channelCount; ++i)
+	{
+		auto address = static_cast<char *>(reserved) + i * ringBytes;
+		ok = mmap(address, ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, off_t(i / 2 * ringBytes)) == address;
+	}
+
+	close(fd);
+
+	if (ok)
+		return reserved;
+
+	if (reserved != MAP_FAILED)
+		munmap(reserved, 2 * channelCount * ringBytes);
+	return nullptr;
+}
+#endif
+
+} // namespace
+
+// Where the platform allows, audio is held in per-channel ring buffers whose memory is mapped twice
+// in succession, so that frames, once delivered, are never moved. Elsewhere, the overlapping frames
+// of successive grains are moved to the start of a linear buffer.
 struct InputBuffer::Implementation
 {
+	float *data;
+	int capacity; // frames per channel
+	int channelStride;
+	std::size_t mappedBytes = 0;
 	std::vector<float> vector;
-	int maxInputFrameCount;
 	int begin = 0;
 	int end = -1;
 	int endRequired = 0;
+
+	Implementation(int maxInputFrameCount, int channelCount)
+	{
+#ifdef BUNGEE_PUSH_MIRRORED
+		const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+		const std::size_t ringBytes = (maxInputFrameCount * sizeof(float) + pageSize - 1) / pageSize * pageSize;
+		if (auto mapped = mapMirroredRings(channelCount, ringBytes))
+		{
+			data = static_cast<float *>(mapped);
+			capacity = int(ringBytes / sizeof(float));
+			channelStride = 2 * capacity;
+			mappedBytes = 2 * channelCount * ringBytes;
+			return;
+		}
+#endif
+		vector.resize(maxInputFrameCount * channelCount);
+		data = vector.data();
+		capacity = channelStride = maxInputFrameCount;
+	}
+
+	~Implementation()
+	{
+#ifdef BUNGEE_PUSH_MIRRORED
+		if (mappedBytes)
+			munmap(data, mappedBytes);
+#endif
+	}
+
+	float *frame(int position) const
+	{
+		if (mappedBytes)
+			return data + (position % capacity + capacity) % capacity;
+		else
+			return data + (position - begin);
+	}
 };
 
 InputBuffer::InputBuffer(int maxInputFrameCount, int channelCount) :
-	state(new Implementation)
+	state(new Implementation(maxInputFrameCount, channelCount))
 {
-	state->vector.resize(maxInputFrameCount * channelCount);
-	state->maxInputFrameCount = maxInputFrameCount;
 }
 
 InputBuffer::~InputBuffer()
@@ -43,14 +140,17 @@ void InputBuffer::grain(const InputChunk &inputChunk)
 	}
 	else
 	{
-		const int offset = inputChunk.begin - state->begin;
-
-		// loop over channels, move lapped segment to start of buffer
-		for (int x = 0; x < (int)state->vector.size(); x += stride())
-			std::move(
-				&state->vector[x + offset],
-				&state->vector[x + offset + overlap],
-				&state->vector[x]);
+		if (!state->mappedBytes)
+		{
+			const int offset = inputChunk.begin - state->begin;
+
+			// loop over channels, move lapped segment to start of buffer
+			for (int x = 0; x < (int)state->vector.size(); x += stride())
+				std::move(
+					&state->vector[x + offset],
+					&state->vector[x + offset + overlap],
+					&state->vector[x]);
+		}
 
 		state->begin = inputChunk.begin;
 	}
@@ -69,7 +169,7 @@ void InputBuffer::deliver(int frameCount)
 
 float *InputBuffer::inputData()
 {
-	return &state->vector[state->end - state->begin];
+	return state->frame(state->end);
 }
 
 int InputBuffer::inputFrameCountRequired() const
@@ -79,17 +179,17 @@ int InputBuffer::inputFrameCountRequired() const
 
 int InputBuffer::inputFrameCountMax() const
 {
-	return stride() - (state->end - state->begin);
+	return state->capacity - (state->end - state->begin);
 }
 
 const float *InputBuffer::outputData() const
 {
-	return state->vector.data();
+	return state->frame(state->begin);
 }
 
 int InputBuffer::stride() const
 {
-	return state->maxInputFrameCount;
+	return state->channelStride;
 }
 
 } // namespace Bungee::Push
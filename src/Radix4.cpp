@@ -0,0 +1,512 @@
+// Copyright (C) 2020-2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+// This file is compiled once for each instruction set enabled by the BUNGEE_FOURIER_ENGINES build option,
+// with BUNGEE_RADIX4_ISA naming the instruction set. Everything here, other than the kernel's own members,
+// has internal linkage so that code built with wide vector instructions cannot leak into other translation units.
+
+#include "Radix4.h"
+#include "Assert.h"
+
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#ifndef BUNGEE_RADIX4_ISA
+#	define BUNGEE_RADIX4_ISA generic
+#endif
+
+namespace Bungee::Fourier {
+
+namespace {
+
+constexpr Isa isa = Isa::BUNGEE_RADIX4_ISA;
+constexpr int lanes = Radix4<isa>::lanes;
+
+typedef float Vector __attribute__((vector_size(lanes * sizeof(float))));
+
+inline Vector load(const float *p)
+{
+	Vector v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline void store(float *p, const Vector &v)
+{
+	std::memcpy(p, &v, sizeof(v));
+}
+
+// Offset of the real part of complex element i in block-split layout, the imaginary part follows block floats later
+inline int index(int i, int block)
+{
+	return (i & -block) * 2 + (i & (block - 1));
+}
+
+template <typename T>
+inline void multiply(T &re, T &im, const T &wr, const T &wi)
+{
+	const T r = re * wr - im * wi;
+	im = re * wi + im * wr;
+	re = r;
+}
+
+// Equivalent to two successive radix-2 decimation-in-frequency passes so that output ends up bit-reversed
+template <bool inverse, typename T>
+inline void butterfly(T (&re)[4], T (&im)[4], const T (&wr)[3], const T (&wi)[3])
+{
+	const T a0r = re[0] + re[2], a0i = im[0] + im[2];
+	const T a1r = re[0] - re[2], a1i = im[0] - im[2];
+	const T a2r = re[1] + re[3], a2i = im[1] + im[3];
+	const T dr = re[1] - re[3], di = im[1] - im[3];
+
+	// multiply by -i (forward) or +i (inverse)
+	const T a3r = inverse ? -di : di;
+	const T a3i = inverse ? dr : -dr;
+
+	re[0] = a0r + a2r;
+	im[0] = a0i + a2i;
+
+	re[1] = a0r - a2r;
+	im[1] = a0i - a2i;
+	multiply(re[1], im[1], wr[1], wi[1]);
+
+	re[2] = a1r + a3r;
+	im[2] = a1i + a3i;
+	multiply(re[2], im[2], wr[0], wi[0]);
+
+	re[3] = a1r - a3r;
+	im[3] = a1i - a3i;
+	multiply(re[3], im[3], wr[2], wi[2]);
+}
+
+// Radix-4 pass over blocks of n complex values, twiddles for the pass are laid out as w1r, w1i, w2r, w2i, w3r, w3i
+template <bool inverse>
+void passVector(float *data, int size, int n, const float *w)
+{
+	const int q = n / 4;
+	for (int b = 0; b < size; b += n)
+		for (int j = 0; j < q; j += lanes)
+		{
+			Vector re[4], im[4], wr[3], wi[3];
+			for (int k = 0; k < 4; ++k)
+			{
+				re[k] = load(data + 2 * (b + j + k * q));
+				im[k] = load(data + 2 * (b + j + k * q) + lanes);
+			}
+			for (int k = 0; k < 3; ++k)
+			{
+				wr[k] = load(w + 2 * k * q + j);
+				wi[k] = load(w + (2 * k + 1) * q + j);
+				if constexpr (inverse)
+					wi[k] = -wi[k];
+			}
+
+			butterfly<inverse>(re, im, wr, wi);
+
+			for (int k = 0; k < 4; ++k)
+			{
+				store(data + 2 * (b + j + k * q), re[k]);
+				store(data + 2 * (b + j + k * q) + lanes, im[k]);
+			}
+		}
+}
+
+// As passVector but for passes whose butterflies span fewer complex values than a vector holds
+template <bool inverse>
+void passScalar(float *data, int size, int n, int block, const float *w)
+{
+	const int q = n / 4;
+	for (int b = 0; b < size; b += n)
+		for (int j = 0; j < q; ++j)
+		{
+			int x[4];
+			float re[4], im[4], wr[3], wi[3];
+			for (int k = 0; k < 4; ++k)
+			{
+				x[k] = index(b + j + k * q, block);
+				re[k] = data[x[k]];
+				im[k] = data[x[k] + block];
+			}
+			for (int k = 0; k < 3; ++k)
+			{
+				wr[k] = w[2 * k * q + j];
+				wi[k] = inverse ? -w[(2 * k + 1) * q + j] : w[(2 * k + 1) * q + j];
+			}
+
+			butterfly<inverse>(re, im, wr, wi);
+
+			for (int k = 0; k < 4; ++k)
+			{
+				data[x[k]] = re[k];
+				data[x[k] + block] = im[k];
+			}
+		}
+}
+
+// Final pass of transforms whose size is an odd power of two
+void passRadix2(float *data, int size, int block)
+{
+	for (int b = 0; b < size; b += 2)
+	{
+		const int x0 = index(b, block);
+		const int x1 = index(b + 1, block);
+		for (int part = 0; part < 2 * block; part += block)
+		{
+			const float a = data[x0 + part];
+			const float c = data[x1 + part];
+			data[x0 + part] = a + c;
+			data[x1 + part] = a - c;
+		}
+	}
+}
+
+// In-place complex transform of block-split data, output is bit-reversed
+template <bool inverse>
+void transform(float *data, int size, int block, const float *w)
+{
+	int n = size;
+	for (; n >= 4; n /= 4)
+	{
+		if (n / 4 >= lanes)
+			passVector<inverse>(data, size, n, w);
+		else
+			passScalar<inverse>(data, size, n, block, w);
+		w += 6 * (n / 4);
+	}
+
+	if (n == 2)
+		passRadix2(data, size, block);
+}
+
+// Converts complex data between interleaved and block-split layouts, source and destination may be the same
+template <bool toSplit>
+void convert(float *destination, const float *source, int size, int block)
+{
+	float temporary[2 * lanes];
+	for (int b = 0; b < 2 * size; b += 2 * block)
+	{
+		std::memcpy(temporary, source + b, 2 * block * sizeof(float));
+		for (int i = 0; i < block; ++i)
+			if constexpr (toSplit)
+			{
+				destination[b + i] = temporary[2 * i];
+				destination[b + block + i] = temporary[2 * i + 1];
+			}
+			else
+			{
+				destination[b + 2 * i] = temporary[i];
+				destination[b + 2 * i + 1] = temporary[block + i];
+			}
+	}
+}
+
+void reverse(float *data, int size, const int32_t *reversal)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		const int r = reversal[i];
+		if (i < r)
+			for (int part = 0; part < 2; ++part)
+			{
+				const float swap = data[2 * i + part];
+				data[2 * i + part] = data[2 * r + part];
+				data[2 * r + part] = swap;
+			}
+	}
+}
+
+// Forward transform's final step: spectrum x of a real signal from the spectrum z of its samples paired as complex values.
+// Input and output may be the same buffer, x has one more complex element than z.
+void untangle(float *x, const float *z, int size, const float *table)
+{
+	const int half = size / 2 + 1;
+	const float *wr = table;
+	const float *wi = table + half;
+
+	const float r = z[0], i = z[1];
+	x[0] = r + i;
+	x[1] = 0.f;
+	x[2 * size] = r - i;
+	x[2 * size + 1] = 0.f;
+
+	for (int k = 1; k < half; ++k)
+	{
+		const int m = size - k;
+
+		// even (e) and odd (o) samples' spectra from Z[k] and conj(Z[m])
+		const float er = 0.5f * (z[2 * k] + z[2 * m]);
+		const float ei = 0.5f * (z[2 * k + 1] - z[2 * m + 1]);
+		float or_ = 0.5f * (z[2 * k + 1] + z[2 * m + 1]);
+		float oi = 0.5f * (z[2 * m] - z[2 * k]);
+		multiply(or_, oi, wr[k], wi[k]);
+
+		x[2 * k] = er + or_;
+		x[2 * k + 1] = ei + oi;
+		x[2 * m] = er - or_;
+		x[2 * m + 1] = oi - ei;
+	}
+}
+
+// Inverse transform's first step, the reverse of untangle (scaled by two). Imaginary parts of the DC and Nyquist bins are ignored.
+void tangle(float *z, const float *x, int size, const float *table)
+{
+	const int half = size / 2 + 1;
+	const float *wr = table;
+	const float *wi = table + half;
+
+	const float x0 = x[0], xn = x[2 * size];
+	z[0] = x0 + xn;
+	z[1] = x0 - xn;
+
+	for (int k = 1; k < half; ++k)
+	{
+		const int m = size - k;
+
+		// e = X[k] + conj(X[m]), d = (X[k] - conj(X[m])) * conj(w)
+		const float er = x[2 * k] + x[2 * m];
+		const float ei = x[2 * k + 1] - x[2 * m + 1];
+		float dr = x[2 * k] - x[2 * m];
+		float di = x[2 * k + 1] + x[2 * m + 1];
+		multiply(dr, di, wr[k], -wi[k]);
+
+		// Z[k] = e + i * d, Z[m] = conj(e - i * d)
+		z[2 * k] = er - di;
+		z[2 * k + 1] = ei + dr;
+		z[2 * m] = er + di;
+		z[2 * m + 1] = dr - ei;
+	}
+}
+
+// Multichannel transforms hold a group of channels in "lane" layout: each complex element occupies one vector
+// of real parts followed by one vector of imaginary parts, with one channel per vector lane.
+template <int width>
+struct Batch
+{
+	typedef float Vector __attribute__((vector_size(width * sizeof(float))));
+
+	static inline Vector load(const float *p)
+	{
+		Vector v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static inline void store(float *p, const Vector &v)
+	{
+		std::memcpy(p, &v, sizeof(v));
+	}
+
+	static void gather(float *data, const float *columns, std::ptrdiff_t stride, int size)
+	{
+		for (int n = 0; n < size; ++n)
+			for (int c = 0; c < width; ++c)
+			{
+				data[2 * width * n + c] = columns[c * stride + 2 * n];
+				data[2 * width * n + width + c] = columns[c * stride + 2 * n + 1];
+			}
+	}
+
+	static void scatter(float *columns, std::ptrdiff_t stride, const float *data, int size, const int32_t *reversal)
+	{
+		for (int n = 0; n < size; ++n)
+		{
+			const int r = reversal[n];
+			for (int c = 0; c < width; ++c)
+			{
+				columns[c * stride + 2 * r] = data[2 * width * n + c];
+				columns[c * stride + 2 * r + 1] = data[2 * width * n + width + c];
+			}
+		}
+	}
+
+	template <bool inverse>
+	static void transform(float *data, int size, const float *w)
+	{
+		int n = size;
+		for (; n >= 4; n /= 4)
+		{
+			const int q = n / 4;
+			for (int b = 0; b < size; b += n)
+				for (int j = 0; j < q; ++j)
+				{
+					Vector re[4], im[4], wr[3], wi[3];
+					for (int k = 0; k < 4; ++k)
+					{
+						re[k] = load(data + 2 * width * (b + j + k * q));
+						im[k] = load(data + 2 * width * (b + j + k * q) + width);
+					}
+					for (int k = 0; k < 3; ++k)
+					{
+						wr[k] = Vector{} + w[2 * k * q + j];
+						wi[k] = Vector{} + (inverse ? -w[(2 * k + 1) * q + j] : w[(2 * k + 1) * q + j]);
+					}
+
+					butterfly<inverse>(re, im, wr, wi);
+
+					for (int k = 0; k < 4; ++k)
+					{
+						store(data + 2 * width * (b + j + k * q), re[k]);
+						store(data + 2 * width * (b + j + k * q) + width, im[k]);
+					}
+				}
+			w += 6 * q;
+		}
+
+		if (n == 2)
+			for (int b = 0; b < size; b += 2)
+				for (int part = 0; part < 2 * width; part += width)
+				{
+					const Vector a = load(data + 2 * width * b + part);
+					const Vector c = load(data + 2 * width * (b + 1) + part);
+					store(data + 2 * width * b + part, a + c);
+					store(data + 2 * width * (b + 1) + part, a - c);
+				}
+	}
+};
+
+// Transforms as many groups of width channels as possible, using f as workspace, returns the first untransformed channel
+template <int width>
+int forwardBatches(int c, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride, int size, const float *table, const float *w, const int32_t *reversal)
+{
+	if constexpr (width <= lanes)
+		for (; channelCount - c >= width; c += width)
+		{
+			auto data = reinterpret_cast<float *>(f + c * fStride);
+			Batch<width>::gather(data, t + c * tStride, tStride, size);
+			Batch<width>::template transform<false>(data, size, w);
+			Batch<width>::scatter(t + c * tStride, tStride, data, size, reversal);
+			for (int i = c; i < c + width; ++i)
+				untangle(reinterpret_cast<float *>(f + i * fStride), t + i * tStride, size, table);
+		}
+	return c;
+}
+
+// Transforms as many groups of width channels as possible, using f as workspace, returns the first untransformed channel
+template <int width>
+int inverseBatches(int c, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride, int size, const float *table, const float *w, const int32_t *reversal)
+{
+	if constexpr (width <= lanes)
+		for (; channelCount - c >= width; c += width)
+		{
+			for (int i = c; i < c + width; ++i)
+				tangle(t + i * tStride, reinterpret_cast<const float *>(f + i * fStride), size, table);
+			auto data = reinterpret_cast<float *>(f + c * fStride);
+			Batch<width>::gather(data, t + c * tStride, tStride, size);
+			Batch<width>::template transform<true>(data, size, w);
+			Batch<width>::scatter(t + c * tStride, tStride, data, size, reversal);
+		}
+	return c;
+}
+
+} // namespace
+
+template <Isa isa>
+Radix4<isa>::Kernel::Kernel(int log2TransformLength) :
+	log2Size(log2TransformLength - 1),
+	block((1 << log2Size) < lanes ? (1 << log2Size) : lanes)
+{
+	BUNGEE_ASSERT1(log2Size >= 0);
+
+	const int size = 1 << log2Size;
+	const int half = size / 2 + 1;
+
+	int count = 2 * half;
+	for (int n = size; n >= 4; n /= 4)
+		count += 6 * (n / 4);
+
+	table = new float[count];
+	reversal = new int32_t[size];
+
+	// e^(-i * pi * k / size) for the split of the real transform into a half-length complex transform
+	float *w = table;
+	for (int k = 0; k < half; ++k)
+	{
+		const double theta = std::numbers::pi * k / size;
+		w[k] = float(std::cos(theta));
+		w[half + k] = float(-std::sin(theta));
+	}
+	w += 2 * half;
+
+	for (int n = size; n >= 4; n /= 4)
+	{
+		const int q = n / 4;
+		for (int k = 1; k <= 3; ++k)
+			for (int j = 0; j < q; ++j)
+			{
+				const double theta = -2 * std::numbers::pi * j * k / n;
+				w[(2 * k - 2) * q + j] = float(std::cos(theta));
+				w[(2 * k - 1) * q + j] = float(std::sin(theta));
+			}
+		w += 6 * q;
+	}
+
+	for (int i = 0; i < size; ++i)
+	{
+		reversal[i] = 0;
+		for (int b = 0; b < log2Size; ++b)
+			if (i >> b & 1)
+				reversal[i] |= 1 << (log2Size - 1 - b);
+	}
+}
+
+template <Isa isa>
+Radix4<isa>::Kernel::~Kernel()
+{
+	delete[] table;
+	delete[] reversal;
+}
+
+template <Isa isa>
+void Radix4<isa>::Kernel::forward(int log2TransformLength, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const
+{
+	BUNGEE_ASSERT1(log2TransformLength == log2Size + 1);
+
+	const int size = 1 << log2Size;
+	const int half = size / 2 + 1;
+	const float *w = table + 2 * half;
+
+	int c = 0;
+	c = forwardBatches<16>(c, channelCount, t, tStride, f, fStride, size, table, w, reversal);
+	c = forwardBatches<8>(c, channelCount, t, tStride, f, fStride, size, table, w, reversal);
+	c = forwardBatches<4>(c, channelCount, t, tStride, f, fStride, size, table, w, reversal);
+
+	for (; c < channelCount; ++c)
+	{
+		auto z = reinterpret_cast<float *>(f + c * fStride);
+		convert<true>(z, t + c * tStride, size, block);
+		transform<false>(z, size, block, w);
+		convert<false>(z, z, size, block);
+		reverse(z, size, reversal);
+		untangle(z, z, size, table);
+	}
+}
+
+template <Isa isa>
+void Radix4<isa>::Kernel::inverse(int log2TransformLength, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const
+{
+	BUNGEE_ASSERT1(log2TransformLength == log2Size + 1);
+
+	const int size = 1 << log2Size;
+	const int half = size / 2 + 1;
+	const float *w = table + 2 * half;
+
+	int c = 0;
+	c = inverseBatches<16>(c, channelCount, t, tStride, f, fStride, size, table, w, reversal);
+	c = inverseBatches<8>(c, channelCount, t, tStride, f, fStride, size, table, w, reversal);
+	c = inverseBatches<4>(c, channelCount, t, tStride, f, fStride, size, table, w, reversal);
+
+	for (; c < channelCount; ++c)
+	{
+		auto z = t + c * tStride;
+		tangle(z, reinterpret_cast<const float *>(f + c * fStride), size, table);
+		convert<true>(z, z, size, block);
+		transform<true>(z, size, block, w);
+		convert<false>(z, z, size, block);
+		reverse(z, size, reversal);
+	}
+}
+
+template struct Radix4<isa>::Kernel;
+
+} // namespace Bungee::Fourier
@@ -0,0 +1,53 @@
+// Copyright (C) 2020-2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+// This header is included by translation units built with differing instruction-set flags,
+// so it deliberately avoids Eigen and any other inline library code.
+
+namespace Bungee::Fourier {
+
+enum class Isa
+{
+	generic, // SSE2 on x86-64, NEON on Arm64, scalar elsewhere
+	avx2,
+	avx512,
+};
+
+// Real-to-complex FFT engine: a half-length complex transform computed in place using radix-4
+// decimation-in-frequency passes over a block-split layout, in which every block of `lanes` complex
+// values stores `lanes` real parts followed by `lanes` imaginary parts, such that butterflies
+// need no shuffles. When there are enough channels, groups of 4, 8 or 16 channels are instead transformed
+// together with one channel per vector lane. The same twiddle tables serve both forward and inverse transforms.
+template <Isa isa>
+struct Radix4
+{
+	static constexpr int lanes = isa == Isa::avx512 ? 16 : isa == Isa::avx2 ? 8 : 4;
+
+	struct Kernel
+	{
+		int log2Size; // of the complex transform, which has half the real transform's length
+		int block; // complex values per block-split block
+		float *table; // radix-4 pass twiddles followed by real-transform twiddles
+		int32_t *reversal; // bit-reversal permutation
+
+		Kernel(int log2TransformLength);
+		~Kernel();
+
+		Kernel(const Kernel &) = delete;
+		Kernel &operator=(const Kernel &) = delete;
+
+		void forward(int log2TransformLength, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const;
+		void inverse(int log2TransformLength, int channelCount, float *t, std::ptrdiff_t tStride, std::complex<float> *f, std::ptrdiff_t fStride) const;
+	};
+
+	typedef Kernel Forward;
+	typedef Kernel Inverse;
+};
+
+} // namespace Bungee::Fourier
@@ -2,3 +2,81 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "Resample.h"
+
+#include <array>
+#include <cmath>
+#include <numbers>
+
+namespace Bungee::Resample {
+
+namespace {
+
+double besselI0(double x)
+{
+	double sum = 1., term = 1.;
+	for (int k = 1; term > 1e-12 * sum; ++k)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Kaiser-windowed sinc, its cutoff slightly below Nyquist so that the transition band fits within the taps.
+// Bins that would alias on output are already zeroed during analysis, so a single table serves all ratios.
+template <int taps>
+std::array<float, (Sinc<taps>::phases + 1) * taps> tabulateSinc()
+{
+	constexpr double cutoff = 1. - 2. / taps;
+	constexpr double beta = 4. + taps / 8.;
+	constexpr double halfWidth = taps / 2;
+
+	std::array<float, (Sinc<taps>::phases + 1) * taps> table;
+	for (int p = 0; p <= Sinc<taps>::phases; ++p)
+	{
+		const double fraction = double(p) / Sinc<taps>::phases;
+
+		double h[taps];
+		double sum = 0.;
+		for (int k = 0; k < taps; ++k)
+		{
+			const double d = k - halfWidth + 1 - fraction;
+			const double u = std::min(1., std::abs(d) / halfWidth);
+			const double x = std::numbers::pi * cutoff * d;
+			h[k] = (x == 0. ? 1. : std::sin(x) / x) * besselI0(beta * std::sqrt(1. - u * u));
+			sum += h[k];
+		}
+
+		for (int k = 0; k < taps; ++k)
+			table[p * taps + k] = float(h[k] / sum);
+	}
+	return table;
+}
+
+} // namespace
+
+template <int taps>
+const float *Sinc<taps>::table()
+{
+	static const auto table = tabulateSinc<taps>();
+	return table.data();
+}
+
+template struct Sinc<8>;
+template struct Sinc<16>;
+template struct Sinc<32>;
+
+namespace {
+// Tables are built as the library loads so that no stretcher need build them on an audio thread
+static const struct TabulateSincs
+{
+	TabulateSincs()
+	{
+		Sinc<8>::table();
+		Sinc<16>::table();
+		Sinc<32>::table();
+	}
+} tabulateSincs;
+} // namespace
+
+} // namespace Bungee::Resample
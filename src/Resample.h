@@ -3,94 +3,164 @@
 
 #pragma once
 
+#include "Arena.h"
 #include "Assert.h"
 #include "bungee/Bungee.h"
 
 #include <Eigen/Dense>
 
+#include <algorithm>
+#include <cstdint>
 #include <type_traits>
 
 namespace Bungee::Resample {
 
-typedef Eigen::Ref<Eigen::ArrayXXf> Ref;
-typedef Eigen::Block<Ref, 1, Eigen::Dynamic, false> Row;
+// Variable-rate audio may have any frame stride, so that interleaved audio is read and written in place
+typedef Eigen::Ref<Eigen::ArrayXXf, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>> Ref;
+
+// Interpolation taps of a block of variable-rate frames: variable frame i is associated with fixed frames
+// index[i] + t, weighted by coefficient[t][i]. Tabulating taps for a block before looping over channels
+// leaves the per-channel loops free of loop-carried dependencies so that they vectorise.
+template <int taps>
+struct Taps
+{
+	static constexpr int capacity = 64;
+	int32_t index[capacity];
+	float coefficient[taps ? taps : 1][capacity];
+};
 
 struct FixedToVariable
 {
-	static inline float applyGain(float coefficient, float)
+	template <int taps>
+	static inline void applyGain(Taps<taps> &, const float *, int)
 	{
-		return coefficient;
 	}
 
-	template <bool first>
-	static inline void tap(float fixed, float &__restrict variable, float coefficient)
+	template <int taps, bool contiguous>
+	static inline void apply(const Taps<taps> &t, int n, float *__restrict fixed, float *__restrict variable, std::ptrdiff_t step)
 	{
-		if constexpr (first)
-			variable = fixed * coefficient;
-		else
-			variable += fixed * coefficient;
+		if constexpr (contiguous)
+			step = 1;
+		for (int i = 0; i < n; ++i)
+		{
+			float sum = fixed[t.index[i]] * t.coefficient[0][i];
+			for (int k = 1; k < taps; ++k)
+				sum += fixed[t.index[i] + k] * t.coefficient[k][i];
+			variable[i * step] = sum;
+		}
 	}
 };
 
 struct VariableToFixed
 {
-	static inline float applyGain(float coefficient, float gain)
+	template <int taps>
+	static inline void applyGain(Taps<taps> &t, const float *gain, int n)
 	{
-		return coefficient * gain;
+		for (int k = 0; k < taps; ++k)
+			for (int i = 0; i < n; ++i)
+				t.coefficient[k][i] *= gain[i];
 	}
 
-	template <bool>
-	static inline void tap(float &__restrict fixed, float variable, float coefficient)
+	template <int taps, bool contiguous>
+	static inline void apply(const Taps<taps> &t, int n, float *__restrict fixed, float *__restrict variable, std::ptrdiff_t step)
 	{
-		fixed += variable * coefficient;
+		if constexpr (contiguous)
+			step = 1;
+		// scatter: consecutive frames may share taps so this loop stays scalar
+		for (int i = 0; i < n; ++i)
+			for (int k = 0; k < taps; ++k)
+				fixed[t.index[i] + k] += variable[i * step] * t.coefficient[k][i];
 	}
 };
 
 struct None
 {
-	template <class Mode>
-	static inline void step(float, Ref, Row, float)
+	static constexpr int taps = 0;
+
+	static inline void tabulate(const float *, int, Taps<taps> &)
 	{
 	}
 };
 
 struct Nearest
 {
-	template <class Mode>
-	static inline void step(float offset, Ref fixed, Row variable, float gain)
+	static constexpr int taps = 1;
+
+	static inline void tabulate(const float *x, int n, Taps<taps> &t)
 	{
-		int x = int(offset + 0.5f);
-		for (int c = 0; c < fixed.cols(); ++c)
-			Mode::template tap<true>(fixed(x, c), variable(0, c), Mode::applyGain(1.f, gain));
+		for (int i = 0; i < n; ++i)
+		{
+			t.index[i] = int(x[i] + 0.5f);
+			t.coefficient[0][i] = 1.f;
+		}
 	}
 };
 
 struct Bilinear
 {
-	template <class Mode>
-	static inline void step(float offset, Ref fixed, Row variable, float gain)
+	static constexpr int taps = 2;
+
+	static inline void tabulate(const float *x, int n, Taps<taps> &t)
 	{
-		int x = int(offset);
-		float k = offset - x;
-		for (int c = 0; c < fixed.cols(); ++c)
+		for (int i = 0; i < n; ++i)
 		{
-			Mode::template tap<true>(fixed(x + 1, c), variable(0, c), Mode::applyGain(k, gain));
-			Mode::template tap<false>(fixed(x, c), variable(0, c), Mode::applyGain(1.f - k, gain));
+			const int j = int(x[i]);
+			const float k = x[i] - j;
+			t.index[i] = j;
+			t.coefficient[0][i] = 1.f - k;
+			t.coefficient[1][i] = k;
 		}
 	}
 };
 
+// Windowed-sinc interpolation. Coefficients are tabulated once, for all stretchers, at a number of
+// fractional phases and are linearly interpolated between phases.
+template <int taps_>
+struct Sinc
+{
+	static constexpr int taps = taps_;
+	static constexpr int phases = 256;
+
+	// phases + 1 rows each of taps coefficients, row p being for fractional position p / phases
+	static const float *table();
+
+	static inline void tabulate(const float *x, int n, Taps<taps> &t)
+	{
+		const float *h = table();
+
+		int32_t row[Taps<taps>::capacity];
+		float w[Taps<taps>::capacity];
+		for (int i = 0; i < n; ++i)
+		{
+			const int j = int(x[i]);
+			const float p = (x[i] - j) * phases;
+			row[i] = int(p);
+			w[i] = p - row[i];
+			t.index[i] = j - taps / 2 + 1;
+		}
+
+		for (int k = 0; k < taps; ++k)
+			for (int i = 0; i < n; ++i)
+			{
+				const float a = h[row[i] * taps + k];
+				const float b = h[(row[i] + 1) * taps + k];
+				t.coefficient[k][i] = a + w[i] * (b - a);
+			}
+	}
+};
+
 struct Padded
 {
 	static constexpr auto align = std::max<int>(EIGEN_DEFAULT_ALIGN_BYTES / sizeof(float), 1);
-	static constexpr auto padding = (6 + align - 1) / align * align;
+	static constexpr auto maxTaps = 32;
+	static constexpr auto padding = (std::max(6, maxTaps / 2 + 2) + align - 1) / align * align;
 
-	Eigen::ArrayXXf array;
+	Eigen::Map<Eigen::ArrayXXf> array;
 	int frameCount{};
 	bool allZeros{true};
 
-	Padded(int maxFrameCount, int channelCount) :
-		array(padding + maxFrameCount + padding, channelCount)
+	Padded(int maxFrameCount, int channelCount, Arena &arena) :
+		array(arena.array<Eigen::ArrayXXf>(padding + maxFrameCount + padding, channelCount))
 	{
 	}
 
@@ -114,21 +184,47 @@ inline void resampleInner(int variableFrameCount, Padded &fixedBuffer, float &fi
 	if constexpr (std::is_same_v<Mode, VariableToFixed>)
 		fixedBuffer.array.setZero();
 
+	typedef Taps<Interpolation::taps> Table;
+	Table table;
+	float x[Table::capacity];
+	float gain[Table::capacity];
+
 	const auto offset = Padded::padding + fixedBufferOffset;
-	float ratio = ratioBegin;
-	for (int i = 0; i < variableFrameCount; ++i)
-		if constexpr (ratioChange)
+	for (int begin = 0; begin < variableFrameCount; begin += Table::capacity)
+	{
+		const int n = std::min<int>(Table::capacity, variableFrameCount - begin);
+
+		for (int j = 0; j < n; ++j)
 		{
-			const float x = offset + i * (ratioBegin + ratio) * .5f;
-			ratio = ratioBegin + ratioGradient * i;
-			Interpolation::template step<Mode>(x, fixedBuffer.array, variableBuffer.row(i), ratio);
+			const int i = begin + j;
+			if constexpr (ratioChange)
+			{
+				const float ratioPrevious = i ? ratioBegin + ratioGradient * (i - 1) : ratioBegin;
+				x[j] = offset + i * (ratioBegin + ratioPrevious) * .5f;
+				gain[j] = ratioBegin + ratioGradient * i;
+			}
+			else
+			{
+				x[j] = offset + i * ratioBegin;
+				gain[j] = ratioBegin;
+			}
 		}
-		else
+
+		if constexpr (Interpolation::taps != 0)
 		{
-			const float x = offset + i * ratio;
-			Interpolation::template step<Mode>(x, fixedBuffer.array, variableBuffer.row(i), ratio);
+			Interpolation::tabulate(x, n, table);
+			Mode::applyGain(table, gain, n);
+
+			const auto step = variableBuffer.innerStride();
+			for (int c = 0; c < fixedBuffer.array.cols(); ++c)
+				if (step == 1)
+					Mode::template apply<Interpolation::taps, true>(table, n, &fixedBuffer.array(0, c), &variableBuffer(begin, c), step);
+				else
+					Mode::template apply<Interpolation::taps, false>(table, n, &fixedBuffer.array(0, c), &variableBuffer(begin, c), step);
 		}
+	}
 
+	const float ratio = ratioChange && variableFrameCount ? ratioBegin + ratioGradient * (variableFrameCount - 1) : ratioBegin;
 	fixedBufferOffset += variableFrameCount * (ratioBegin + ratio) * .5f;
 	fixedBufferOffset -= fixedBuffer.frameCount;
 }
@@ -168,6 +264,19 @@ inline int resample(Padded &fixedBuffer, float &fixedBufferOffset, Ref variableB
 
 typedef decltype(&resample<FixedToVariable, Nearest>) Function;
 
+template <class Mode>
+inline Function function(InterpolationMode interpolationMode)
+{
+	if (interpolationMode == InterpolationMode::sinc8)
+		return &resample<Mode, Sinc<8>>;
+	else if (interpolationMode == InterpolationMode::sinc16)
+		return &resample<Mode, Sinc<16>>;
+	else if (interpolationMode == InterpolationMode::sinc32)
+		return &resample<Mode, Sinc<32>>;
+	else
+		return &resample<Mode, Bilinear>;
+}
+
 struct Operation
 {
 	Function function;
@@ -178,22 +287,14 @@ struct Operations
 {
 	Operation input, output;
 
-	double setup(const SampleRates &sampleRates, ResampleMode resampleMode, double pitch)
+	double setup(const SampleRates &sampleRates, ResampleMode resampleMode, double pitch, InterpolationMode interpolationMode = InterpolationMode::bilinear)
 	{
 		const double resampleRatio = pitch * sampleRates.input / sampleRates.output;
 		input.ratio = 1.f / resampleRatio;
 		output.ratio = resampleRatio;
 
-		if constexpr (true)
-		{
-			input.function = &resample<VariableToFixed, Bilinear>;
-			output.function = &resample<FixedToVariable, Bilinear>;
-		}
-		else
-		{
-			input.function = &resample<VariableToFixed, Nearest>;
-			output.function = &resample<FixedToVariable, Nearest>;
-		}
+		input.function = function<VariableToFixed>(interpolationMode);
+		output.function = function<FixedToVariable>(interpolationMode);
 
 		if (resampleMode == ResampleMode::forceOut)
 			input.function = nullptr;
@@ -6,16 +6,52 @@
 #include "Synthesis.h"
 #include "log2.h"
 
+#include <new>
+
 namespace Bungee {
 
-Stretcher::Stretcher(SampleRates sampleRates, int channelCount) :
-	state(new Implementation(sampleRates, channelCount))
+void warmUp(SampleRates sampleRates, ProfileMode profileMode)
 {
+	const Timing timing(sampleRates, profileMode);
+	Input::prepareTransforms(timing.log2SynthesisHop);
+	Output::prepareTransforms(timing.log2SynthesisHop);
+}
+
+namespace {
+static const struct WarmUpCommonSampleRates
+{
+	WarmUpCommonSampleRates()
+	{
+		warmUp({44100, 44100});
+		warmUp({48000, 48000});
+	}
+} warmUpCommonSampleRates;
+} // namespace
+
+Stretcher::Stretcher(SampleRates sampleRates, int channelCount, ProfileMode profileMode, PipelineMode pipelineMode) :
+	state(Implementation::create(sampleRates, channelCount, profileMode, pipelineMode, nullptr))
+{
+}
+
+Stretcher::Stretcher(SampleRates sampleRates, int channelCount, void *arena, ProfileMode profileMode, PipelineMode pipelineMode) :
+	state(Implementation::create(sampleRates, channelCount, profileMode, pipelineMode, arena))
+{
+	BUNGEE_ASSERT1(arena);
 }
 
 Stretcher::~Stretcher()
 {
-	delete state;
+	auto ownedMemory = state->ownedMemory;
+	state->~Implementation();
+	delete[] ownedMemory;
+}
+
+std::size_t Stretcher::requiredBytes(SampleRates sampleRates, int channelCount, ProfileMode profileMode, PipelineMode pipelineMode)
+{
+	Arena arena;
+	auto implementation = new (arena.allocate<Implementation>(1)) Implementation(sampleRates, channelCount, profileMode, arena, nullptr, pipelineMode);
+	implementation->~Implementation();
+	return arena.required();
 }
 
 InputChunk Stretcher::specifyGrain(const Request &request)
@@ -28,6 +64,11 @@ int Stretcher::maxInputFrameCount() const
 	return state->maxInputFrameCount(true);
 }
 
+int Stretcher::maxOutputFrameCount() const
+{
+	return state->maxOutputFrameCount(true);
+}
+
 void Stretcher::preroll(Request &request) const
 {
 	state->preroll(request);
@@ -43,106 +84,361 @@ void Stretcher::analyseGrain(const float *data, intptr_t channelStride)
 	state->analyseGrain(data, channelStride);
 }
 
+void Stretcher::analyseGrain(const float *data, intptr_t channelStride, intptr_t frameStride)
+{
+	state->analyseGrain(data, channelStride, frameStride);
+}
+
 void Stretcher::synthesiseGrain(OutputChunk &outputChunk)
 {
 	state->synthesiseGrain(outputChunk);
 }
 
+void Stretcher::synthesiseGrainInterleaved(OutputChunk &outputChunk)
+{
+	state->synthesiseGrain(outputChunk, true);
+}
+
+void Stretcher::synthesiseGrain(OutputChunk &outputChunk, const OutputDestination &destination)
+{
+	state->synthesiseGrain(outputChunk, false, &destination);
+}
+
 bool Stretcher::isFlushed() const
 {
-	return state->grains.flushed();
+	return state->isFlushed();
+}
+
+Statistics Stretcher::statistics() const
+{
+	Statistics statistics{};
+	state->counters.snapshot(statistics);
+	return statistics;
+}
+
+void Stretcher::setAnalysisCache(AnalysisCache *analysisCache)
+{
+	if (state->pipeline.ahead)
+		state->awaitAnalysis();
+
+	state->analysisCache = analysisCache ? analysisCache->state : nullptr;
+	state->cacheEntry = nullptr;
+	state->analysisCached = false;
+}
+
+bool Stretcher::isAnalysisCached() const
+{
+	return state->analysisCached;
+}
+
+// When pipelined, the grain ahead and grains[0] are live at once, so neither transformed buffers nor windowed input may be shared
+Stretcher::Implementation::Implementation(SampleRates sampleRates, int channelCount, ProfileMode profileMode, Arena &arena, const Placement *placement, PipelineMode pipelineMode) :
+	Timing(sampleRates, profileMode),
+	bypassPassthrough(!placement && pipelineMode == PipelineMode::sequential),
+	input(log2SynthesisHop, channelCount, arena, placement ? placement->windowedInput : nullptr),
+	grains(log2SynthesisHop, channelCount, arena, placement ? placement->transformed : nullptr, pipelineMode == PipelineMode::sequential),
+	output(log2SynthesisHop, channelCount, maxOutputFrameCount(true), 0.25f, {1.f, 0.5f}, arena, pipelineMode == PipelineMode::sequential ? input.windowedInput.data() : nullptr)
+{
+	BUNGEE_ASSERT1(!placement || pipelineMode == PipelineMode::sequential);
+	if (pipelineMode == PipelineMode::twoThread)
+		pipeline.ahead = new (arena.allocate<Grain>(1)) Grain(log2SynthesisHop, channelCount, arena);
+}
+
+Stretcher::Implementation::~Implementation()
+{
+	if (pipeline.worker.joinable())
+	{
+		pipeline.stopping.store(true, std::memory_order_relaxed);
+		pipeline.posted.fetch_add(1, std::memory_order_release);
+		pipeline.posted.notify_one();
+		pipeline.worker.join();
+	}
+
+	if (pipeline.ahead)
+		pipeline.ahead->~Grain();
+}
+
+Stretcher::Implementation *Stretcher::Implementation::create(SampleRates sampleRates, int channelCount, ProfileMode profileMode, PipelineMode pipelineMode, void *memory)
+{
+	static_assert(alignof(Implementation) <= Arena::alignment);
+
+	char *ownedMemory = nullptr;
+	if (!memory)
+		memory = ownedMemory = new char[requiredBytes(sampleRates, channelCount, profileMode, pipelineMode)];
+
+	Arena arena(memory);
+	auto implementation = new (arena.allocate<Implementation>(1)) Implementation(sampleRates, channelCount, profileMode, arena, nullptr, pipelineMode);
+	implementation->ownedMemory = ownedMemory;
+
+	if (pipelineMode == PipelineMode::twoThread)
+		implementation->pipeline.worker = std::thread(&Implementation::runWorker, implementation);
+
+	return implementation;
+}
+
+void Stretcher::Implementation::runWorker()
+{
+	for (std::uint32_t posted = 0;;)
+	{
+		pipeline.posted.wait(posted, std::memory_order_acquire);
+		posted = pipeline.posted.load(std::memory_order_acquire);
+		if (pipeline.stopping.load(std::memory_order_relaxed))
+			return;
+
+		{
+			const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT | FE_UNDERFLOW | FE_DENORMALOPERAND);
+			const Assert::RealTime realTime;
+			analyseWindowed();
+		}
+
+		pipeline.completed.store(posted, std::memory_order_release);
+		pipeline.completed.notify_one();
+	}
+}
+
+void Stretcher::Implementation::awaitAnalysis()
+{
+	const auto posted = pipeline.posted.load(std::memory_order_relaxed);
+	for (auto completed = pipeline.completed.load(std::memory_order_acquire); completed != posted; completed = pipeline.completed.load(std::memory_order_acquire))
+		pipeline.completed.wait(completed, std::memory_order_acquire);
 }
 
-Stretcher::Implementation::Implementation(SampleRates sampleRates, int channelCount) :
-	Timing(sampleRates),
-	input(log2SynthesisHop, channelCount),
-	grains(4),
-	output(log2SynthesisHop, channelCount, maxOutputFrameCount(true), 0.25f, {1.f, 0.5f})
+bool Stretcher::Implementation::isFlushed() const
 {
-	for (auto &grain : grains.vector)
-		grain = std::make_unique<Grain>(log2SynthesisHop, channelCount);
+	return grains.flushed() && !(pipeline.ahead && pipeline.ahead->valid());
 }
 
 InputChunk Stretcher::Implementation::specifyGrain(const Request &request)
 {
 	const Assert::FloatingPointExceptions floatingPointExceptions(0);
+	const Assert::RealTime realTime;
 
-	grains.rotate();
+	if (pipeline.ahead)
+	{
+		awaitAnalysis();
+		pipeline.ahead = grains.rotate(pipeline.ahead);
+	}
+	else
+		grains.rotate();
 
-	auto &grain = grains[0];
-	auto &previous = grains[1];
-	return grain.specify(request, previous, sampleRates, log2SynthesisHop);
+	auto &grain = analysisGrain();
+	auto &previous = analysisPrevious();
+	const auto inputChunk = grain.specify(request, previous, sampleRates, log2SynthesisHop);
+
+	// Unrotated bins that all survive output resampling make the inverse transform reproduce the windowed input
+	grain.bypass = bypassPassthrough && grain.passthrough == 1 && grain.resampleOperations.output.ratio <= 1.f;
+
+	counters.countGrain(grain.valid(), grain.continuous, grain.passthrough, grain.resampleOperations.input.function || grain.resampleOperations.output.function);
+
+	cacheEntry = nullptr;
+	analysisCached = false;
+	if (analysisCache && grain.valid() && !grain.bypass)
+	{
+		const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT);
+		cacheKey = AnalysisCache::Implementation::key(grain, log2SynthesisHop + 3);
+		cacheEntry = analysisCache->find(cacheKey);
+		analysisCached = AnalysisCache::Implementation::hit(cacheEntry, cacheKey);
+	}
+
+	return inputChunk;
 }
 
-void Stretcher::Implementation::analyseGrain(const float *data, std::ptrdiff_t stride)
+void Stretcher::Implementation::analyseGrain(const float *data, std::ptrdiff_t channelStride, std::ptrdiff_t frameStride)
 {
 	const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT | FE_UNDERFLOW | FE_DENORMALOPERAND);
+	const Assert::RealTime realTime;
+
+	analyseBypassedPredecessor();
+
+	if (analysisCached)
+		analyseCached();
+	else if (windowGrain(data, channelStride, frameStride) && !analysisGrain().bypass)
+	{
+		if (pipeline.ahead)
+		{
+			pipeline.posted.fetch_add(1, std::memory_order_release);
+			pipeline.posted.notify_one();
+		}
+		else
+			analyseWindowed();
+	}
+}
+
+void Stretcher::Implementation::analyseWindowed()
+{
+	auto &grain = analysisGrain();
+	{
+		const Instrumentation::Scope scope(counters, Statistics::forwardTransform, pipeline.ahead != nullptr);
+		Fourier::transforms().forward(grain.log2TransformLength, input.windowedInput, grain.transformed);
+	}
+	analyseTransformed();
+}
 
+void Stretcher::Implementation::analyseBypassedPredecessor()
+{
 	auto &grain = grains[0];
-	grain.validBinCount = 0;
-	if (grain.valid())
+	auto &previous = grains[1];
+	if (!grain.valid() || !grain.continuous || grain.bypass || !previous.bypass)
+		return;
+
 	{
-		auto m = grain.inputChunkMap(data, stride);
-		auto ref = grain.resampleInput(m, 8 << log2SynthesisHop);
+		const Instrumentation::Scope scope(counters, Statistics::forwardTransform);
+		Fourier::transforms().forward(previous.log2TransformLength, input.windowedInput, previous.transformed);
+	}
 
-		auto log2TransformLength = input.applyAnalysisWindow(ref);
+	const Instrumentation::Scope scope(counters, Statistics::analysis);
+	analyseBins(previous);
+	previous.rotation.topRows(previous.validBinCount).setZero();
+}
 
-		Fourier::transforms.forward(log2TransformLength, input.windowedInput, grain.transformed);
+bool Stretcher::Implementation::windowGrain(const float *data, std::ptrdiff_t channelStride, std::ptrdiff_t frameStride)
+{
+	auto &grain = analysisGrain();
+	grain.validBinCount = 0;
+	if (!grain.valid())
+		return false;
+
+	auto m = grain.inputChunkMap(data, channelStride, frameStride);
+	auto ref = [&] {
+		const Instrumentation::Scope scope(counters, Statistics::resample);
+		return grain.resampleInput(m, log2SynthesisHop + 3, input.resampled);
+	}();
+
+	const Instrumentation::Scope scope(counters, Statistics::analysis);
+	grain.log2TransformLength = input.applyAnalysisWindow(ref);
+	return true;
+}
 
-		const auto n = Fourier::binCount(grain.log2TransformLength) - 1;
-		grain.validBinCount = std::min<int>(std::ceil(n / grain.resampleOperations.output.ratio), n) + 1;
-		grain.transformed.middleRows(grain.validBinCount, n + 1 - grain.validBinCount).setZero();
+void Stretcher::Implementation::analyseTransformed()
+{
+	const Instrumentation::Scope scope(counters, Statistics::analysis, pipeline.ahead != nullptr);
 
-		grain.log2TransformLength = log2TransformLength;
+	auto &grain = analysisGrain();
 
-		for (int i = 0; i < grain.validBinCount; ++i)
-		{
-			const auto x = grain.transformed.row(i).sum();
-			grain.energy[i] = x.real() * x.real() + x.imag() * x.imag();
-			grain.phase[i] = Phase::fromRadians(std::arg(x));
-		}
+	analyseBins(grain);
+
+	Partials::enumerate(grain.partials, grain.validBinCount, grain.energy);
+
+	if (cacheEntry)
+		analysisCache->store(cacheEntry, cacheKey, grain);
+
+	if (grain.continuous)
+		Partials::suppressTransientPartials(grain.partials, grain.energy, analysisPrevious().energy);
+}
+
+void Stretcher::Implementation::analyseCached()
+{
+	const Instrumentation::Scope scope(counters, Statistics::analysis);
 
-		Partials::enumerate(grain.partials, grain.validBinCount, grain.energy);
+	auto &grain = analysisGrain();
 
-		if (grain.continuous)
-			Partials::suppressTransientPartials(grain.partials, grain.energy, grains[1].energy);
+	analysisCache->load(cacheEntry, grain);
+
+	if (grain.continuous)
+		Partials::suppressTransientPartials(grain.partials, grain.energy, analysisPrevious().energy);
+}
+
+void Stretcher::Implementation::analyseBins(Grain &grain)
+{
+	const auto n = Fourier::binCount(grain.log2TransformLength) - 1;
+	grain.validBinCount = grain.requiredBinCount();
+	grain.transformed.middleRows(grain.validBinCount, n + 1 - grain.validBinCount).setZero();
+
+	// Energy and phase of the sum over channels, a block of bins at a time so that every loop vectorises
+	for (int begin = 0; begin < grain.validBinCount; begin += 64)
+	{
+		const int count = std::min(64, grain.validBinCount - begin);
+		float x[64], y[64];
+		for (int i = 0; i < count; ++i)
+		{
+			x[i] = grain.transformed(begin + i, 0).real();
+			y[i] = grain.transformed(begin + i, 0).imag();
+		}
+		for (int c = 1; c < grain.transformed.cols(); ++c)
+			for (int i = 0; i < count; ++i)
+			{
+				x[i] += grain.transformed(begin + i, c).real();
+				y[i] += grain.transformed(begin + i, c).imag();
+			}
+		for (int i = 0; i < count; ++i)
+		{
+			grain.energy[begin + i] = x[i] * x[i] + y[i] * y[i];
+			grain.phase[begin + i] = Phase::fromComplex(x[i], y[i]);
+		}
 	}
 }
 
-void Stretcher::Implementation::synthesiseGrain(OutputChunk &outputChunk)
+void Stretcher::Implementation::synthesiseGrain(OutputChunk &outputChunk, bool interleaved, const OutputDestination *destination)
 {
 	const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT);
+	const Assert::RealTime realTime;
 
-	auto &grain = grains[0];
-	if (grain.valid())
+	if (!grains[0].bypass && rotateGrain())
 	{
-		auto n = Fourier::binCount(grain.log2TransformLength);
+		const Instrumentation::Scope scope(counters, Statistics::inverseTransform);
+		Fourier::transforms().inverse(grains[0].log2TransformLength, output.inverseTransformed, grains[0].transformed);
+	}
+
+	overlapAddGrain(outputChunk, interleaved, destination);
+}
 
-		BUNGEE_ASSERT1(!grain.passthrough || grain.analysis.speed == grain.passthrough);
+bool Stretcher::Implementation::rotateGrain()
+{
+	auto &grain = grains[0];
+	if (!grain.valid())
+		return false;
 
-		Synthesis::synthesise(log2SynthesisHop, grain, grains[1]);
+	const Instrumentation::Scope scope(counters, Statistics::synthesis);
 
-		BUNGEE_ASSERT2(!grain.passthrough || grain.rotation.topRows(grain.validBinCount).isZero());
+	BUNGEE_ASSERT1(!grain.passthrough || grain.analysis.speed == grain.passthrough);
 
-		auto theta = grain.rotation.topRows(grain.validBinCount).cast<float>() * (std::numbers::pi_v<float> / 0x8000);
-		auto t = theta.cos() + theta.sin() * std::complex<float>{0, 1};
-		if (grain.reverse())
-			grain.transformed.topRows(grain.validBinCount) = grain.transformed.topRows(grain.validBinCount).conjugate().colwise() * t;
-		else
-			grain.transformed.topRows(grain.validBinCount).colwise() *= t;
+	Synthesis::synthesise(log2SynthesisHop, grain, grains[1]);
+
+	BUNGEE_ASSERT2(!grain.passthrough || grain.rotation.topRows(grain.validBinCount).isZero());
+
+	Synthesis::rotate(grain);
 
-		Fourier::transforms.inverse(grain.log2TransformLength, output.inverseTransformed, grain.transformed);
+	return true;
+}
+
+void Stretcher::Implementation::overlapAddGrain(OutputChunk &outputChunk, bool interleaved, const OutputDestination *destination)
+{
+	{
+		const Instrumentation::Scope scope(counters, Statistics::synthesis);
+		applySynthesisWindow();
 	}
+	{
+		const Instrumentation::Scope scope(counters, Statistics::resample);
+		resampleOutput(outputChunk, interleaved);
+		if (destination)
+			output.mix(outputChunk, *destination);
+	}
+
+	counters.endGrain();
+}
 
-	output.applySynthesisWindow(log2SynthesisHop, grains, output.synthesisWindow);
+void Stretcher::Implementation::applySynthesisWindow()
+{
+	if (grains[0].bypass)
+		output.applySynthesisWindow(log2SynthesisHop, grains, output.bypassWindow, input.windowedInput);
+	else
+		output.applySynthesisWindow(log2SynthesisHop, grains, output.synthesisWindow, output.inverseTransformed);
+}
 
+void Stretcher::Implementation::resampleOutput(OutputChunk &outputChunk, bool interleaved)
+{
 	Output::Segment::lapPadding(grains[3].segment, grains[2].segment);
 
+	// An interleaved view of bufferResampled's memory: frame f of channel c is at f * channelCount + c
+	typedef Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> Stride;
+	const auto channelCount = output.bufferResampled.cols();
+	Eigen::Map<Eigen::ArrayXXf, 0, Stride> bufferInterleaved(output.bufferResampled.data(), output.bufferResampled.rows(), channelCount, Stride(1, channelCount));
+
 	outputChunk = grains[3].segment.resample(
 		output.resampleOffset,
 		grains[2].resampleOperations.output,
 		grains[1].resampleOperations.output,
-		output.bufferResampled);
+		interleaved ? Resample::Ref(bufferInterleaved) : Resample::Ref(output.bufferResampled));
 
 	outputChunk.request[OutputChunk::begin] = &grains[2].request;
 	outputChunk.request[OutputChunk::end] = &grains[1].request;
@@ -3,27 +3,114 @@
 
 #pragma once
 
+#include "AnalysisCache.h"
 #include "Grains.h"
 #include "Input.h"
+#include "Instrumentation.h"
 #include "Output.h"
 #include "Timing.h"
 
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
 namespace Bungee {
 
 struct Stretcher::Implementation :
 	Timing
 {
+	// Addresses of the transform buffers of a StretcherBank voice. These are held as adjacent columns of blocks
+	// shared by all the bank's voices so that every voice's grain may be transformed in one call.
+	struct Placement
+	{
+		float *windowedInput;
+		std::complex<float> *transformed;
+	};
+
+	// State of PipelineMode::twoThread. Once the caller has windowed a grain, the worker thread transforms and
+	// analyses it while the caller synthesises grains[0]. Grains are handed over by the two counters alone.
+	struct Pipeline
+	{
+		Grain *ahead{}; // the grain being analysed, which specifyGrain rotates into grains[0] once the worker completes it
+		std::atomic<std::uint32_t> posted{}; // count of grains handed to the worker
+		std::atomic<std::uint32_t> completed{}; // count of grains the worker has analysed
+		std::atomic<bool> stopping{};
+		std::thread worker;
+	};
+
+	char *ownedMemory{};
+	const bool bypassPassthrough; // false for StretcherBank voices, whose transforms are batched whether or not they pass through
 	Input input;
 	Grains grains;
-	Output output;
+	Output output; // output.inverseTransformed shares input.windowedInput, which the forward transform has consumed, unless pipelined
+	Instrumentation::Counters counters;
+	Pipeline pipeline;
+	AnalysisCache::Implementation *analysisCache{};
+	AnalysisCache::Implementation::Key cacheKey{}; // of analysisGrain(), if cacheEntry is not null
+	AnalysisCache::Implementation::Entry *cacheEntry{}; // the slot that holds, or is to hold, analysisGrain()'s analysis
+	bool analysisCached{}; // analysisGrain()'s analysis is held in cacheEntry
+
+	Implementation(SampleRates sampleRates, int channelCount, ProfileMode profileMode, Arena &arena, const Placement *placement = nullptr, PipelineMode pipelineMode = PipelineMode::sequential);
+	~Implementation();
+
+	// Constructs an Implementation at the start of memory or, if memory is null, in a heap block that it then owns.
+	static Implementation *create(SampleRates sampleRates, int channelCount, ProfileMode profileMode, PipelineMode pipelineMode, void *memory);
 
-	Implementation(SampleRates sampleRates, int channelCount);
+	// The grain that specifyGrain and analyseGrain work on and its predecessor
+	Grain &analysisGrain()
+	{
+		return pipeline.ahead ? *pipeline.ahead : grains[0];
+	}
+
+	Grain &analysisPrevious()
+	{
+		return pipeline.ahead ? grains[0] : grains[1];
+	}
+
+	// Blocks until the worker has analysed every grain handed to it
+	void awaitAnalysis();
+
+	void runWorker();
 
 	InputChunk specifyGrain(const Request &request);
 
-	void analyseGrain(const float *inputAudio, std::ptrdiff_t stride);
+	void analyseGrain(const float *inputAudio, std::ptrdiff_t channelStride, std::ptrdiff_t frameStride = 1);
+
+	// A grain that leaves bypass needs the analysis that its bypassed predecessor skipped. That predecessor's
+	// windowed input is still held in input.windowedInput so must be transformed before windowGrain overwrites it.
+	void analyseBypassedPredecessor();
+
+	// First stage of analyseGrain: returns false if the grain is invalid, otherwise fills input.windowedInput
+	bool windowGrain(const float *inputAudio, std::ptrdiff_t channelStride, std::ptrdiff_t frameStride = 1);
+
+	// Second stage of analyseGrain, performed on the worker thread if and only if pipelined: transforms and analyses input.windowedInput
+	void analyseWindowed();
+
+	// Final stage of analyseGrain, following the forward transform of input.windowedInput
+	void analyseTransformed();
+
+	// Replaces all stages of analyseGrain for a grain whose analysis is held in the cache
+	void analyseCached();
+
+	// Computes the energy and phase of a transformed grain's bins
+	static void analyseBins(Grain &grain);
+
+	// If interleaved, outputChunk's audio is interleaved in output.bufferResampled.
+	// If destination is given, the audio is then mixed into it and outputChunk is updated to describe it there.
+	void synthesiseGrain(OutputChunk &outputChunk, bool interleaved = false, const OutputDestination *destination = nullptr);
+
+	// First stage of synthesiseGrain: returns false if the grain is invalid, otherwise prepares the grain's transformed bins
+	bool rotateGrain();
+
+	// Final stage of synthesiseGrain, following the inverse transform into output.inverseTransformed or, for a
+	// bypass grain, following windowGrain directly
+	void overlapAddGrain(OutputChunk &outputChunk, bool interleaved = false, const OutputDestination *destination = nullptr);
+
+	// First part of overlapAddGrain: windows the grain's output and adds it to the lapped segments
+	void applySynthesisWindow();
 
-	void synthesiseGrain(OutputChunk &outputChunk);
+	// Second part of overlapAddGrain, following the synthesis window: resamples the completed output segment
+	void resampleOutput(OutputChunk &outputChunk, bool interleaved = false);
 
 	bool isFlushed() const;
 };
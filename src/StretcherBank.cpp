@@ -0,0 +1,182 @@
+// Copyright (C) 2020-2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#include "StretcherBank.h"
+
+#include <new>
+
+namespace Bungee {
+
+StretcherBank::StretcherBank(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode) :
+	state(Implementation::create(sampleRates, channelCount, voiceCount, profileMode, nullptr))
+{
+}
+
+StretcherBank::StretcherBank(SampleRates sampleRates, int channelCount, int voiceCount, void *arena, ProfileMode profileMode) :
+	state(Implementation::create(sampleRates, channelCount, voiceCount, profileMode, arena))
+{
+	BUNGEE_ASSERT1(arena);
+}
+
+StretcherBank::~StretcherBank()
+{
+	auto ownedMemory = state->ownedMemory;
+	state->~Implementation();
+	delete[] ownedMemory;
+}
+
+std::size_t StretcherBank::requiredBytes(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode)
+{
+	Arena arena;
+	auto implementation = new (arena.allocate<Implementation>(1)) Implementation(sampleRates, channelCount, voiceCount, profileMode, arena);
+	implementation->~Implementation();
+	return arena.required();
+}
+
+int StretcherBank::voiceCount() const
+{
+	return state->voiceCount;
+}
+
+int StretcherBank::maxInputFrameCount() const
+{
+	return state->maxInputFrameCount(true);
+}
+
+int StretcherBank::maxOutputFrameCount() const
+{
+	return state->maxOutputFrameCount(true);
+}
+
+void StretcherBank::preroll(Request &request) const
+{
+	state->preroll(request);
+}
+
+void StretcherBank::next(Request &request) const
+{
+	state->next(request);
+}
+
+void StretcherBank::specifyGrains(const Request requests[], InputChunk inputChunks[])
+{
+	state->specifyGrains(requests, inputChunks);
+}
+
+void StretcherBank::analyseGrains(const float *const data[], const intptr_t channelStrides[])
+{
+	state->analyseGrains(data, channelStrides);
+}
+
+void StretcherBank::synthesiseGrains(OutputChunk outputChunks[])
+{
+	state->synthesiseGrains(outputChunks);
+}
+
+void StretcherBank::synthesiseGrains(OutputChunk outputChunks[], const OutputDestination destinations[])
+{
+	state->synthesiseGrains(outputChunks, destinations);
+}
+
+bool StretcherBank::isFlushed(int voice) const
+{
+	BUNGEE_ASSERT1(voice >= 0 && voice < state->voiceCount);
+	return state->voices[voice]->grains.flushed();
+}
+
+StretcherBank::Implementation::Implementation(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode, Arena &arena) :
+	Timing(sampleRates, profileMode),
+	channelCount(channelCount),
+	voiceCount(voiceCount),
+	voices(arena.allocate<Stretcher::Implementation *>(voiceCount))
+{
+	BUNGEE_ASSERT1(voiceCount > 0);
+
+	const int log2TransformLength = log2SynthesisHop + 3;
+	const int columns = channelCount * voiceCount;
+
+	auto windowedInput = arena.array<Eigen::ArrayXXf>(8 << log2SynthesisHop, columns);
+	auto transformed = Fourier::allocate<true, Eigen::ArrayXXcf>(arena, log2TransformLength, columns);
+
+	for (int v = 0; v < voiceCount; ++v)
+	{
+		const auto column = v * channelCount;
+
+		Stretcher::Implementation::Placement placement;
+		placement.windowedInput = &windowedInput(0, column);
+		placement.transformed = &transformed(0, column);
+
+		voices[v] = new (arena.allocate<Stretcher::Implementation>(1)) Stretcher::Implementation(sampleRates, channelCount, profileMode, arena, &placement);
+	}
+}
+
+StretcherBank::Implementation::~Implementation()
+{
+	for (int v = 0; v < voiceCount; ++v)
+		voices[v]->~Implementation();
+}
+
+StretcherBank::Implementation *StretcherBank::Implementation::create(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode, void *memory)
+{
+	static_assert(alignof(Implementation) <= Arena::alignment);
+
+	char *ownedMemory = nullptr;
+	if (!memory)
+		memory = ownedMemory = new char[requiredBytes(sampleRates, channelCount, voiceCount, profileMode)];
+
+	Arena arena(memory);
+	auto implementation = new (arena.allocate<Implementation>(1)) Implementation(sampleRates, channelCount, voiceCount, profileMode, arena);
+	implementation->ownedMemory = ownedMemory;
+	return implementation;
+}
+
+void StretcherBank::Implementation::specifyGrains(const Request requests[], InputChunk inputChunks[])
+{
+	for (int v = 0; v < voiceCount; ++v)
+		inputChunks[v] = voices[v]->specifyGrain(requests[v]);
+}
+
+void StretcherBank::Implementation::analyseGrains(const float *const data[], const intptr_t channelStrides[])
+{
+	const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT | FE_UNDERFLOW | FE_DENORMALOPERAND);
+	const Assert::RealTime realTime;
+
+	bool anyValid = false;
+	for (int v = 0; v < voiceCount; ++v)
+		if (voices[v]->windowGrain(data[v], channelStrides[v]))
+			anyValid = true;
+		else
+			voices[v]->input.windowedInput.setZero();
+
+	if (!anyValid)
+		return;
+
+	auto &first = *voices[0];
+	Fourier::transforms().forward(log2SynthesisHop + 3, allVoices(first.input.windowedInput), allVoices(first.grains[0].transformed));
+
+	for (int v = 0; v < voiceCount; ++v)
+		if (voices[v]->grains[0].valid())
+			voices[v]->analyseTransformed();
+}
+
+void StretcherBank::Implementation::synthesiseGrains(OutputChunk outputChunks[], const OutputDestination destinations[])
+{
+	const Assert::FloatingPointExceptions floatingPointExceptions(FE_INEXACT);
+	const Assert::RealTime realTime;
+
+	bool anyValid = false;
+	for (int v = 0; v < voiceCount; ++v)
+		if (voices[v]->rotateGrain())
+			anyValid = true;
+
+	if (anyValid)
+	{
+		auto &first = *voices[0];
+		Fourier::transforms().inverse(log2SynthesisHop + 3, allVoices(first.output.inverseTransformed), allVoices(first.grains[0].transformed));
+	}
+
+	for (int v = 0; v < voiceCount; ++v)
+		voices[v]->overlapAddGrain(outputChunks[v], false, destinations ? &destinations[v] : nullptr);
+}
+
+} // namespace Bungee
@@ -0,0 +1,38 @@
+// Copyright (C) 2020-2024 Parabola Research Limited
+// SPDX-License-Identifier: MPL-2.0
+
+#pragma once
+
+#include "Stretcher.h"
+
+namespace Bungee {
+
+struct StretcherBank::Implementation :
+	Timing
+{
+	char *ownedMemory{};
+	const int channelCount;
+	const int voiceCount;
+	Stretcher::Implementation **voices;
+
+	Implementation(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode, Arena &arena);
+	~Implementation();
+
+	// Constructs an Implementation at the start of memory or, if memory is null, in a heap block that it then owns.
+	static Implementation *create(SampleRates sampleRates, int channelCount, int voiceCount, ProfileMode profileMode, void *memory);
+
+	// Views a buffer of the first voice as the corresponding buffer of all voices, their columns being adjacent.
+	template <class Map>
+	Map allVoices(Map &first) const
+	{
+		return Map(first.data(), first.rows(), first.cols() * voiceCount);
+	}
+
+	void specifyGrains(const Request requests[], InputChunk inputChunks[]);
+
+	void analyseGrains(const float *const data[], const intptr_t channelStrides[]);
+
+	void synthesiseGrains(OutputChunk outputChunks[], const OutputDestination destinations[] = nullptr);
+};
+
+} // namespace Bungee
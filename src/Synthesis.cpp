@@ -69,8 +69,46 @@ void synthesise(int log2SynthesisHop, Grain &grain, Grain &previous)
 
 	BUNGEE_ASSERT2(!grain.passthrough || grain.rotation.topRows(grain.validBinCount).isZero());
 
+	// Draws rotation to zero in equal steps so that the grain after the last realigning grain can pass through
+	if (grain.realign)
+	{
+		const int remaining = Grain::realignGrainCount - grain.realign;
+		for (int n = 0; n < grain.validBinCount; ++n)
+			grain.rotation[n] = Phase::Type(grain.rotation[n] * remaining / (remaining + 1));
+	}
+
 	const auto mNyquist = Fourier::binCount(grain.log2TransformLength) - 1;
 	grain.rotation[mNyquist] = grain.rotation[mNyquist - 1];
 }
 
+void rotate(Grain &grain)
+{
+	// Negating the imaginary part of each input first applies the conjugation of a reversed grain
+	const float sign = grain.reverse() ? -1.f : 1.f;
+
+	for (int begin = 0; begin < grain.validBinCount; begin += 64)
+	{
+		const int count = std::min(64, grain.validBinCount - begin);
+
+		float c[64], s[64];
+		for (int i = 0; i < count; ++i)
+		{
+			const auto t = Phase::toComplex(grain.rotation[begin + i]);
+			c[i] = t.real();
+			s[i] = t.imag();
+		}
+
+		for (int channel = 0; channel < grain.transformed.cols(); ++channel)
+		{
+			auto z = &grain.transformed(begin, channel);
+			for (int i = 0; i < count; ++i)
+			{
+				const float re = z[i].real();
+				const float im = sign * z[i].imag();
+				z[i] = {re * c[i] - im * s[i], re * s[i] + im * c[i]};
+			}
+		}
+	}
+}
+
 } // namespace Bungee::Synthesis
@@ -9,4 +9,7 @@ namespace Bungee::Synthesis {
 
 void synthesise(int log2SynthesisHop, Grain &grain, Grain &previous);
 
+// Multiplies every channel of each valid bin by the unit phasor of grain.rotation, conjugating the spectrum first if the grain is reversed
+void rotate(Grain &grain);
+
 } // namespace Bungee::Synthesis
@@ -8,10 +8,28 @@
 
 #include "bungee/Bungee.h"
 
+#include <cstdint>
+
 namespace Bungee {
 
-Timing::Timing(SampleRates sampleRates) :
-	log2SynthesisHop(log2<true>(sampleRates.input) - 6),
+namespace {
+int log2ProfileScale(ProfileMode profileMode)
+{
+	switch (profileMode)
+	{
+	case ProfileMode::lowLatency:
+		return -1;
+	case ProfileMode::lowCpu:
+		return +1;
+	case ProfileMode::balanced:
+		break;
+	}
+	return 0;
+}
+} // namespace
+
+Timing::Timing(SampleRates sampleRates, ProfileMode profileMode) :
+	log2SynthesisHop(log2<true>(sampleRates.input) - 6 + log2ProfileScale(profileMode)),
 	sampleRates(sampleRates)
 {
 }
@@ -22,14 +40,14 @@ static constexpr auto maxPitchOctaves = 2;
 
 int Timing::maxInputFrameCount(bool mayDownsampleInput) const
 {
-	const auto max = (sampleRates.input << (maxPitchOctaves + log2SynthesisHop + 3)) / sampleRates.output;
-	return max + 1;
+	const auto max = (std::int64_t(sampleRates.input) << (maxPitchOctaves + log2SynthesisHop + 3)) / sampleRates.output;
+	return int(max + 1);
 }
 
 int Timing::maxOutputFrameCount(bool mayUpsampleOutput) const
 {
-	const auto max = (sampleRates.output << (maxPitchOctaves + log2SynthesisHop)) / sampleRates.input;
-	return max + 1;
+	const auto max = (std::int64_t(sampleRates.output) << (maxPitchOctaves + log2SynthesisHop)) / sampleRates.input;
+	return int(max + 1);
 }
 
 double Timing::calculateInputHop(const Request &request) const
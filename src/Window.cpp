@@ -3,28 +3,25 @@
 
 #include "Window.h"
 #include "Assert.h"
-#include "Fourier.h"
 
 #include <Eigen/Dense>
 
 #include <cmath>
+#include <numbers>
 
 namespace Bungee::Window {
 
-Eigen::ArrayXf fromFrequencyDomainCoefficients(int log2Size, float gain, std::initializer_list<float> coefficients)
+void fromFrequencyDomainCoefficients(Eigen::Ref<Eigen::ArrayXf> window, float gain, std::initializer_list<float> coefficients)
 {
-	Eigen::ArrayXcf frequencyDomain(Fourier::binCount(log2Size));
-
-	std::size_t i = 0;
-	for (auto c : coefficients)
-		frequencyDomain.coeffRef(i++) = c * gain;
-
-	frequencyDomain.bottomRows(frequencyDomain.rows() - i).setZero();
-
-	Eigen::ArrayXf window(1 << log2Size);
-	Fourier::transforms.prepareInverse(log2Size);
-	Fourier::transforms.inverse(log2Size, window, frequencyDomain);
-	return window;
+	// Equivalent to an unnormalised inverse FFT of the coefficients but needs neither workspace nor FFT state
+	const double step = 2 * std::numbers::pi / window.rows();
+	for (Eigen::Index n = 0; n < window.rows(); ++n)
+	{
+		double x = 0.;
+		for (int k = 0; k < int(coefficients.size()); ++k)
+			x += (k ? 2. : 1.) * coefficients.begin()[k] * std::cos(step * k * n);
+		window[n] = float(x * gain);
+	}
 }
 
 template <bool add>
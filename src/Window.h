@@ -12,7 +12,8 @@
 
 namespace Bungee::Window {
 
-Eigen::ArrayXf fromFrequencyDomainCoefficients(int log2Size, float gain, std::initializer_list<float> coefficients);
+// Fills window with the cosine-sum window whose (real, symmetric) frequency-domain coefficients are given.
+void fromFrequencyDomainCoefficients(Eigen::Ref<Eigen::ArrayXf> window, float gain, std::initializer_list<float> coefficients);
 
 struct Apply
 {